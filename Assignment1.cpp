@@ -1,6 +1,9 @@
 #include <cstdio>
+#include <cstddef>
 #include <cstdlib>
 #include <cstdint>
+#include <climits>
+#include <cstring>
 #include <cmath>
 #include <vector>
 #include <string>
@@ -9,22 +12,408 @@
 #include <iomanip>
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define MMIP_IO_URING
+#include <linux/io_uring.h>
+#endif
 #include <filesystem>
 #include <algorithm>
+#include <new>
+#include <type_traits>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <charconv>
+#include <atomic>
+#include <sstream>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MMIP_SSE2
+#include <emmintrin.h>
+#endif
 #include <SDL3/SDL.h>
+// stb_image tm飼 decode arena] StbiArenaPool^ASb arena ѽXO@ malloc/free
+void* mmip_stbi_malloc(size_t n);
+void* mmip_stbi_realloc(void* p, size_t n);
+void mmip_stbi_free(void* p);
+#define STBI_MALLOC(sz)    mmip_stbi_malloc(sz)
+#define STBI_REALLOC(p,sz) mmip_stbi_realloc(p, sz)
+#define STBI_FREE(p)       mmip_stbi_free(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 using namespace std;
 namespace fs = std::filesystem;
 
-struct GrayImage{
+// CC_I 64 bytes]@ cache line^ASIMD i aligned loadAhCɤ]|@ cache line
+constexpr int kRowAlign = 64;
+
+// bump allocatorG@Bz̪vqo̤A reset() @k١Av@ free
+// reset  chunk OdUӡAU@ƨϥΤwg fault iӪAíwᤣAI heap
+class Arena {
+public:
+    explicit Arena(size_t chunk_bytes = 4u << 20) : chunk_bytes_(chunk_bytes) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() {
+        for (auto& c : chunks_) ::operator delete(c.base, std::align_val_t(kRowAlign));
+    }
+
+    // align iWL kRowAlign]chunk _IuOҹ kRowAlign^
+    void* allocate(size_t n, size_t align = kRowAlign) {
+        for (; cur_ < chunks_.size(); ++cur_) {
+            Chunk& c = chunks_[cur_];
+            size_t off = (c.used + align - 1) / align * align;
+            if (off + n <= c.size) {
+                c.used = off + n;
+                return c.base + off;
+            }
+        }
+        size_t size = max(n, chunk_bytes_);
+        uint8_t* base = static_cast<uint8_t*>(::operator new(size, std::align_val_t(kRowAlign)));
+        chunks_.push_back({base, size, n});
+        cur_ = chunks_.size() - 1;
+        return base;
+    }
+
+    void reset() {
+        for (auto& c : chunks_) c.used = 0;
+        cur_ = 0;
+    }
+
+    // TO@ܤ n bytes  chunk]utmAw fault^A`qb n HtmbP@W
+    void reserve(size_t n) {
+        for (auto& c : chunks_) if (c.size >= n) return;
+        uint8_t* base = static_cast<uint8_t*>(::operator new(n, std::align_val_t(kRowAlign)));
+        chunks_.push_back({base, n, 0});
+    }
+
+private:
+    struct Chunk { uint8_t* base; size_t size; size_t used; };
+    vector<Chunk> chunks_;
+    size_t cur_{0};
+    size_t chunk_bytes_;
+};
+
+// arena  nullptr ɨ aligned new/deleteF_hq arena Adeallocate ơ] arena reset^
+template <typename T, size_t Align = kRowAlign>
+struct AlignedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, Align>; };
+
+    Arena* arena{nullptr};
+
+    AlignedAllocator() = default;
+    explicit AlignedAllocator(Arena* a) : arena(a) {}
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Align>& o) : arena(o.arena) {}
+
+    T* allocate(size_t n) {
+        if (arena) return static_cast<T*>(arena->allocate(n * sizeof(T), Align));
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+    }
+    void deallocate(T* p, size_t) {
+        if (!arena) ::operator delete(p, std::align_val_t(Align));
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Align>& o) const { return arena == o.arena; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, Align>& o) const { return arena != o.arena; }
+};
+
+// stb_image ѽXΪ arena GCѽX@ arenaAѽXo thread W stb  STBI_MALLOC/REALLOC qASTBI_FREE 
+// ub@Ūɸ̡Areturn  arena N reset ٦^lG̲׿Xb arena WAӬO StbiOutputSlot Ѷivۤv buffer
+// ]vY arena WXA arenaXXzlib WXBǶe RGBKXXoۼvUh^
+// íwCѽXƨϥΤwg fault iӪ chunkAstb AVtέnO
+class StbiArenaPool {
+public:
+    static StbiArenaPool& instance() {
+        static StbiArenaPool pool;
+        return pool;
+    }
+
+    struct Return {
+        StbiArenaPool* pool;
+        void operator()(Arena* a) const {
+            a->reset();
+            lock_guard<mutex> lk(pool->m_);
+            pool->free_.emplace_back(a);
+        }
+    };
+    using Lease = unique_ptr<Arena, Return>;
+
+    Lease lease() {
+        unique_ptr<Arena> a;
+        {
+            lock_guard<mutex> lk(m_);
+            if (!free_.empty()) {
+                a = std::move(free_.back());
+                free_.pop_back();
+            }
+        }
+        if (!a) a = make_unique<Arena>();
+        if (size_t n = reserve_bytes_.load()) a->reserve(n);
+        return Lease(a.release(), Return{this});
+    }
+
+    // ѽXeѱƵ{p榸ѽXζqG᯲X arena Ʀnoj@A㦸ѽXAnX chunk
+    void reserve(size_t bytes) { reserve_bytes_ = bytes; }
+
+private:
+    mutex m_;
+    vector<unique_ptr<Arena>> free_;
+    atomic<size_t> reserve_bytes_{0};
+};
+
+static thread_local Arena* t_stbi_arena = nullptr;
+
+// d򤺳o thread W stb tmb arena WFParallelForPool  helper thread vTAӱ` heap
+struct StbiArenaScope {
+    explicit StbiArenaScope(Arena* a) : prev(t_stbi_arena) { t_stbi_arena = a; }
+    ~StbiArenaScope() { t_stbi_arena = prev; }
+    StbiArenaScope(const StbiArenaScope&) = delete;
+    StbiArenaScope& operator=(const StbiArenaScope&) = delete;
+    Arena* prev;
+};
+
+// IsݹwtnѽXت buffer]KƦC^GѽX stb njpnO̲׿X]wantAJPEG hn 1 byte^BBoSQήɪXoA
+// ̲׿XNgbvۤv buffer ̡AѧAq arena ƻsXӡFused = 0 ܨSQ
+// 쥦]iuO bufferGstb free ɼЦ^ΡB᪺tmٯAArealloc jɷh arenaF
+// ҥHIsݭn stb ^ǪСAOoNӱ`ƻs
+struct StbiOutputSlot {
+    void* ptr{nullptr};
+    size_t want{0};
+    size_t cap{0};
+    size_t used{0};
+};
+
+static thread_local StbiOutputSlot* t_stbi_output = nullptr;
+
+struct StbiOutputScope {
+    explicit StbiOutputScope(StbiOutputSlot* s) : prev(t_stbi_output) { t_stbi_output = s; }
+    ~StbiOutputScope() { t_stbi_output = prev; }
+    StbiOutputScope(const StbiOutputScope&) = delete;
+    StbiOutputScope& operator=(const StbiOutputScope&) = delete;
+    StbiOutputSlot* prev;
+};
+
+// Ce 16 bytes Y]jpBO_b arena W^A malloc  16-byte F
+// free/realloc ݼYMwBzAheap Wަb threadBӽd free T
+struct StbiBlock {
+    size_t size;
+    size_t in_arena;
+};
+
+void* mmip_stbi_malloc(size_t n) {
+    StbiOutputSlot* o = t_stbi_output;
+    if (o && !o->used && (n == o->want || n == o->want + 1) && n <= o->cap) {
+        o->used = n;
+        return o->ptr;
+    }
+    StbiBlock* b = nullptr;
+    if (t_stbi_arena) {
+        try {
+            b = static_cast<StbiBlock*>(t_stbi_arena->allocate(sizeof(StbiBlock) + n, alignof(std::max_align_t)));
+        } catch (const std::bad_alloc&) {
+            return nullptr; //stb H NULL P_O餣
+        }
+    } else {
+        b = static_cast<StbiBlock*>(malloc(sizeof(StbiBlock) + n));
+        if (!b) return nullptr;
+    }
+    b->size = n;
+    b->in_arena = t_stbi_arena != nullptr;
+    return b + 1;
+}
+
+void mmip_stbi_free(void* p) {
+    if (!p) return;
+    if (t_stbi_output && p == t_stbi_output->ptr) { //ت buffer SY
+        t_stbi_output->used = 0;
+        return;
+    }
+    StbiBlock* b = static_cast<StbiBlock*>(p) - 1;
+    if (!b->in_arena) free(b); //arena W reset @_k
+}
+
+void* mmip_stbi_realloc(void* p, size_t n) {
+    if (!p) return mmip_stbi_malloc(n);
+    if (StbiOutputSlot* o = t_stbi_output; o && p == o->ptr) {
+        if (n <= o->cap) {
+            o->used = max<size_t>(n, 1);
+            return p;
+        }
+        void* q = mmip_stbi_malloc(n); //o٦εۡA|AXۤv
+        if (!q) return nullptr;
+        memcpy(q, p, o->used);
+        o->used = 0;
+        return q;
+    }
+    StbiBlock* b = static_cast<StbiBlock*>(p) - 1;
+    if (!b->in_arena) {
+        StbiBlock* nb = static_cast<StbiBlock*>(realloc(b, sizeof(StbiBlock) + n));
+        if (!nb) return nullptr;
+        nb->size = n;
+        return nb + 1;
+    }
+    if (n <= b->size) return p;
+    void* q = mmip_stbi_malloc(n); //arena ajGs@ƻsLh]zlib XWɳ̦hhΤ@^
+    if (!q) return nullptr;
+    memcpy(q, p, b->size);
+    return q;
+}
+
+// UninitGC pixel |Qg쪺X]Ҧ kernel X^Aٱ@ks
+enum class PixInit { Zero, Uninit };
+
+// H reference count @Ϊ pixel buffer]copy-on-write^Gƻsvuh@ӰѦҡA
+// Ĥ@zL mutable_data() ngBB٦OH@ήɤ~uƻs@
+// arena W buffer ƻsɤM` heapAקK@ΰѦҬo arena [Fmove h˱a
+// `NGo T*T& bvQƻsNAOWAngЭsIs mutable_data()
+template <typename T>
+class PixelBuffer {
+public:
+    PixelBuffer() = default;
+    PixelBuffer(size_t n, Arena* arena, PixInit init) : n_(n), arena_(arena) {
+        AlignedAllocator<T> alloc(arena);
+        T* raw = alloc.allocate(n);
+        if (init == PixInit::Zero) memset((void*)raw, 0, n * sizeof(T));
+        // ϶]qP@ allocator tmAarena ҦUivI heap
+        p_ = shared_ptr<T>(raw, [alloc, n](T* q) mutable { alloc.deallocate(q, n); }, alloc);
+    }
+
+    // ޥ~O]mmap ɮסBѽXXK^Ap  deleteraliasing tdӷ̫@ӰѦҮ
+    // readonly  buffer Ĥ@ngɤ@ߥƻs heapA|g^ӷ
+    PixelBuffer(shared_ptr<T> p, size_t n, bool readonly) : p_(std::move(p)), n_(n), readonly_(readonly) {}
+
+    PixelBuffer(const PixelBuffer& o) : p_(o.p_), n_(o.n_), readonly_(o.readonly_) {
+        if (o.arena_) *this = o.clone();
+    }
+    PixelBuffer& operator=(const PixelBuffer& o) {
+        if (this != &o) *this = PixelBuffer(o);
+        return *this;
+    }
+    PixelBuffer(PixelBuffer&&) noexcept = default;
+    PixelBuffer& operator=(PixelBuffer&&) noexcept = default;
+
+    size_t size() const { return n_; }
+    const T* data() const { return p_.get(); }
+    T* mutable_data() {
+        if (p_.use_count() > 1 || readonly_) *this = clone();
+        return p_.get();
+    }
+    bool shared() const { return p_.use_count() > 1; }
+    bool in_arena() const { return arena_ != nullptr; }
+
+private:
+    PixelBuffer clone() const {
+        PixelBuffer c(n_, nullptr, PixInit::Uninit);
+        memcpy((void*)c.p_.get(), (const void*)p_.get(), n_ * sizeof(T));
+        return c;
+    }
+
+    shared_ptr<T> p_;
+    size_t n_{0};
+    bool readonly_{false};
+    Arena* arena_{nullptr};
+};
+
+// U pixel OסG8-bit 0V255B16-bit 0V65535]12-bit PƤ@˩b uint16_t ̡^Bfloat H 0V1 
+template <typename T> struct PixelTraits;
+template <> struct PixelTraits<uint8_t>  { static constexpr double max = 255.0; };
+template <> struct PixelTraits<uint16_t> { static constexpr double max = 65535.0; };
+template <> struct PixelTraits<float>    { static constexpr double max = 1.0; };
+
+// double G^ pixelGƫOM쥻@˪I_Afloat I_
+template <typename T>
+static inline T to_pixel(double v) { return static_cast<T>(v); }
+
+// kernel hjΪгЦ restrictGJBX buffer |AsĶ~Vq
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define MMIP_RESTRICT __restrict
+#else
+#define MMIP_RESTRICT
+#endif
+
+// @C pixelG_I + סCC++17 S std::spanAo̥un̰򥻪
+template <typename T>
+struct Span {
+    T* ptr{nullptr};
+    int len{0};
+    T* data() const { return ptr; }
+    int size() const { return len; }
+    T& operator[](int i) const { return ptr[i]; }
+    T* begin() const { return ptr; }
+    T* end() const { return ptr + len; }
+};
+
+// O骺vϡG + e + strideCBlϰB~ buffer]stbi XBmmap  RAW^uOСAƻs pixel
+template <typename T>
+struct ImageViewT {
+    using value_type = T;
+    const T* data{nullptr};
     int w{0};
     int h{0};
-    vector<uint8_t> pix; // row-majorAjp = w*h uint8_t = 0-255 nsǶpixel
-    uint8_t& at(int x, int y) { return pix[y*w + x]; }
-    const uint8_t& at(int x, int y) const { return pix[y*w + x]; }
+    int stride{0}; // ۾FC_Iۮt pixel ơ]O byte^AKƦC = w
+    const T& at(int x, int y) const { return data[(size_t)y*stride + x]; }
+    Span<const T> row(int y) const { return {data + (size_t)y*stride, w}; } //kernel @߳vCСAv pixel  y*stride+x
+
+    ImageViewT crop(int x, int y, int cw, int ch) const { return {&at(x, y), cw, ch, stride}; }
+};
+
+template <typename T>
+struct GrayImageT{
+    using value_type = T;
+    int w{0};
+    int h{0};
+    int stride{0}; // CCڦΪ pixel ơACC byte Ƹɻ kRowAlign ơAɻϤeOҡB]|gX
+    PixelBuffer<T> pix; // row-majorAjp = stride*hFƻs GrayImageT u@ bufferAgJɤ~U۽ƻs
+    T& at(int x, int y) { return pix.mutable_data()[(size_t)y*stride + x]; }
+    const T& at(int x, int y) const { return pix.data()[(size_t)y*stride + x]; }
+    Span<T> row(int y) { return {pix.mutable_data() + (size_t)y*stride, w}; } //@Τ buffer bo̽ƻsA@Cuˬd@
+    Span<const T> row(int y) const { return {pix.data() + (size_t)y*stride, w}; }
+
+    void allocate(int W, int H, Arena* arena = nullptr, PixInit init = PixInit::Zero) {
+        constexpr int per_line = kRowAlign / (int)sizeof(T);
+        w = W; h = H;
+        stride = (W + per_line - 1) / per_line * per_line;
+        size_t n = (size_t)stride * H;
+        pix = PixelBuffer<T>(n, arena, init);
+    }
+
+    // H~ buffer  pixel]ƻs^Foؼv stride ӨӷƦCA@wC
+    void adopt(PixelBuffer<T> buf, int W, int H, int S) {
+        w = W; h = H; stride = S;
+        pix = std::move(buf);
+    }
+
+    ImageViewT<T> view() const { return {pix.data(), w, h, stride}; }
+    operator ImageViewT<T>() const { return view(); }
 };
 
+using ImageView = ImageViewT<uint8_t>;
+using GrayImage = GrayImageT<uint8_t>; // uint8_t = 0-255 nsǶpixelADy{γo
+using GrayImage16 = GrayImageT<uint16_t>;
+using GrayImageF = GrayImageT<float>;
+
+// kernel JiHO GrayImageT  ImageViewTA value_type X pixel OAন
+template <typename Img> using pixel_of = typename Img::value_type;
+
+// C@Cq_IŪuC byte Ƹɻ 16vmb stride BB_I 16-byte  => iH aligned load ɻBAγBz
+// ۦ GrayImageT @wߡFmWBe׭nO 16 bytes ƪ~ buffer ]
+template <typename T>
+static inline bool rows_padded16(const ImageViewT<T>& v) {
+    size_t row_bytes = (size_t)v.w * sizeof(T), stride_bytes = (size_t)v.stride * sizeof(T);
+    return ((uintptr_t)v.data & 15) == 0 && stride_bytes % 16 == 0 && (row_bytes + 15) / 16 * 16 <= stride_bytes;
+}
+
 //(a)Image reading
 bool ensure_dir(const std::string& path) {
 #ifdef _WIN32
@@ -36,21 +425,227 @@ bool ensure_dir(const std::string& path) {
 }
 
 
-bool read_raw(const string& path, GrayImage& img){
-    FILE* f = fopen(path.c_str(), "rb"); //Ūbinary
-    const int W=512, H=512, N=W*H;
-    if (!f) { 
-        perror(("open " + path).c_str()); 
-        return false; 
+// ŪMgɮסGPOSIX  mmapA kernel uŪ~ fault iӡFWindows S mmapAh^@Ūi heap
+// sequential = true ɥ[ MADV_SEQUENTIALG|qYŪɮס]ѽXJ^ kernel nwŪ
+class MappedFile {
+public:
+    static shared_ptr<MappedFile> open(const string& path, bool sequential = false) {
+        shared_ptr<MappedFile> m(new MappedFile());
+#ifdef _WIN32
+        (void)sequential;
+        ifstream f(path, ios::binary | ios::ate);
+        if (!f) {
+            perror(("open " + path).c_str());
+            return nullptr;
+        }
+        m->size_ = (size_t)f.tellg();
+        m->heap_.resize(m->size_);
+        f.seekg(0);
+        f.read((char*)m->heap_.data(), m->size_);
+        m->data_ = m->heap_.data();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(("open " + path).c_str());
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            perror(("stat " + path).c_str());
+            ::close(fd);
+            return nullptr;
+        }
+        m->size_ = (size_t)st.st_size;
+        if (m->size_ > 0) {
+            void* p = mmap(nullptr, m->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                perror(("mmap " + path).c_str());
+                ::close(fd);
+                return nullptr;
+            }
+            m->data_ = (const uint8_t*)p;
+            if (sequential) madvise(p, m->size_, MADV_SEQUENTIAL);
+        }
+        ::close(fd); //Mgإ߫NAݭn fd
+#endif
+        return m;
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data_) munmap((void*)data_, size_);
+#endif
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    MappedFile() = default;
+    const uint8_t* data_{nullptr};
+    size_t size_{0};
+#ifdef _WIN32
+    vector<uint8_t> heap_;
+#endif
+};
+
+// RAW ؤoPY첾Cw] 512x512BSYFiѩROC --raw-size / --raw-offset wA
+// Ω@ sidecaru<ɦW>.infov]ҡGlena.raw.info^Aeue  [Y첾]vAsidecar u
+struct RawSpec {
+    int w{512};
+    int h{512};
+    size_t offset{0};
+};
+
+// eAoffset + w*h*sample ]෸FXk bytes =  RAW ݭnɮפjp
+static bool raw_spec_bytes(const RawSpec& spec, size_t sample, size_t& bytes) {
+    if (spec.w <= 0 || spec.h <= 0) return false;
+    size_t w = (size_t)spec.w, h = (size_t)spec.h;
+    if (h > SIZE_MAX / w) return false;
+    size_t n = w * h;
+    if (n > (SIZE_MAX - spec.offset) / sample) return false;
+    bytes = spec.offset + n * sample;
+    return true;
+}
+
+// sidecar eXz]e <= 0Bjp^ɦLXĵiA fallbackFsample = C sample  byte 
+RawSpec raw_spec_for(const string& path, const RawSpec& fallback, size_t sample = 1) {
+    RawSpec spec = fallback;
+    ifstream info(path + ".info");
+    if (info && info >> spec.w >> spec.h) {
+        if (!(info >> spec.offset)) spec.offset = 0;
+    } else {
+        return fallback; //S sidecarAŪXe]dUŪF@bȡ^
     }
-    img.w = W; img.h = H; 
-    img.pix.resize(N); //tjpNheap
-    size_t got = fread(img.pix.data(), 1, N, f); //ŪNbyteimg.pix
-    fclose(f);
-    if (got != N) { 
-        cerr << "file size error: " << got << "vs." << N << endl;              
+    size_t bytes;
+    if (!raw_spec_bytes(spec, sample, bytes)) {
+        cerr << path << ".info: invalid RAW size " << spec.w << "x" << spec.h << " (offset " << spec.offset << "), using "
+             << fallback.w << "x" << fallback.h << "\n";
+        return fallback;
+    }
+    return spec;
+}
+
+// RAW O row-majorFT = uint16_t ɨC sample  2 bytes] byte orderA@PXY little-endian^
+// vbMgW]stride = wAƻs^AMgͩRgۼv buffer FngɭԤ~ƻs heap
+template <typename T>
+bool read_raw(const string& path, GrayImageT<T>& img, const RawSpec& spec = RawSpec()){
+    shared_ptr<MappedFile> file = MappedFile::open(path);
+    if (!file) return false;
+    size_t bytes;
+    if (!raw_spec_bytes(spec, sizeof(T), bytes)) {
+        cerr << path << ": invalid RAW size " << spec.w << "x" << spec.h << " (offset " << spec.offset << ")" << endl;
+        return false;
+    }
+    if (spec.offset % alignof(T) != 0) {
+        cerr << path << ": RAW offset " << spec.offset << " is not a multiple of " << alignof(T) << endl;
+        return false;
+    }
+    const size_t N = (size_t)spec.w * spec.h;
+    size_t got = file->size() > spec.offset ? (file->size() - spec.offset) / sizeof(T) : 0;
+    if (got < N) { 
+        cerr << "file size error: " << got << " vs. " << N << endl;              
         return false; 
     }
+    const T* pixels = (const T*)(file->data() + spec.offset);
+    img.adopt(PixelBuffer<T>(shared_ptr<T>(file, const_cast<T*>(pixels)), N, true), spec.w, spec.h, spec.w);
+    return true;
+}
+
+// stbi J@ߥӬMgiӦA stbi_*_from_memory ѽXGٱ FILE*  stdio wĽƻsMC stbi__refill_buffer  callback
+// MgubѽXOd]ѥXӪO stbi t~tm^Fstbi װѼƬO intAWL 2 GB ɮפ䴩
+static shared_ptr<MappedFile> map_stbi_input(const string& path) {
+    auto file = MappedFile::open(path, true);
+    if (file && file->size() > (size_t)INT_MAX) {
+        cerr << path << ": file too large for stb_image\n";
+        return nullptr;
+    }
+    return file;
+}
+
+// uŪYo stb ѽX᪺ePɳqDơGJPEG  jpeg_scale Yp]LiAM stb YpѽX@P^
+// applied  nullptr ɶJڮMΪYpv]O JPEG NO 1^
+static bool stbi_decoded_size(const MappedFile& file, int jpeg_scale, int& w, int& h, int& comp, int* applied = nullptr) {
+    if (!stbi_info_from_memory(file.data(), (int)file.size(), &w, &h, &comp)) return false;
+    bool jpeg = file.size() >= 2 && file.data()[0] == 0xFF && file.data()[1] == 0xD8; //SOIFjpeg_scale u@Φb JPEG
+    int scale = jpeg && jpeg_scale > 1 ? jpeg_scale : 1;
+    w = (w + scale - 1) / scale;
+    h = (h + scale - 1) / scale;
+    if (applied) *applied = scale;
+    return true;
+}
+
+// stb ѽXتvGKƦC]stride = wAM stb XۦP^Aݦhd 16 bytes hn 1 byte ѽX]JPEG^
+// plan_decode ̱GtnFread_gray_any 쪺vwgOoӧΪNΡA_hۤvt
+template <typename T>
+static void allocate_stbi_target(GrayImageT<T>& img, int w, int h) {
+    img.adopt(PixelBuffer<T>((size_t)w * h + 16 / sizeof(T), nullptr, PixInit::Uninit), w, h, w);
+}
+
+template <typename T>
+static bool is_stbi_target(const GrayImageT<T>& img, int w, int h) {
+    return img.w == w && img.h == h && img.stride == w && img.pix.data() && !img.pix.shared()
+        && img.pix.size() >= (size_t)w * h + 16 / sizeof(T);
+}
+
+template <typename T>
+static StbiOutputSlot stbi_output_slot(GrayImageT<T>& img) {
+    return {img.pix.mutable_data(), (size_t)img.w * img.h * sizeof(T), img.pix.size() * sizeof(T), 0};
+}
+
+// 8-bit Ƕȴ TAM stbi_load_16]v*257^Bfloat  16-bit A 65535 G@P
+template <typename T>
+static inline T gray8_to(int v) {
+    if constexpr (std::is_same_v<T, uint8_t>) return (T)v;
+    else if constexpr (std::is_same_v<T, uint16_t>) return (T)(v * 257);
+    else return (T)((v * 257) / 65535.0f);
+}
+
+// Y]BI_RGB^ 8/24/32-bit BMP ǶG@tmتvAvC]ѤUWBt 4-byte ɻ^Ū@MNgX lumaA
+//  stbi__bmp_load i} RGB A stbi__convert_format tĤG buffer Ƕ
+// luma ΩM stbi__compute_y ۦP (r*77 + g*150 + b*29) >> 8AGP stb v pixel ۦPF8-bit զLǶd
+// L]RLEBbitfieldsB1/4/16-bitBOS/2 YBɮ׳QI_K^^ falseAѩIsݥ浹 stb
+template <typename T>
+static bool read_bmp_gray(const MappedFile& file, GrayImageT<T>& img) {
+    const uint8_t* p = file.data();
+    size_t size = file.size();
+    auto le16 = [p](size_t o) { return (uint32_t)p[o] | (uint32_t)p[o + 1] << 8; };
+    auto le32 = [le16](size_t o) { return le16(o) | le16(o + 2) << 16; };
+    if (size < 54 || p[0] != 'B' || p[1] != 'M') return false;
+    size_t offset = le32(10), hsz = le32(14);
+    int32_t w = (int32_t)le32(18), h = (int32_t)le32(22);
+    int bpp = (int)le16(28);
+    if (hsz != 40 && hsz != 56 && hsz != 108 && hsz != 124) return false;
+    if (le16(26) != 1 || le32(30) != 0 || (bpp != 8 && bpp != 24 && bpp != 32)) return false;
+    bool bottom_up = h > 0;
+    if (h < 0) h = -h;
+    if (w <= 0 || h <= 0 || w > (1 << 24) || h > (1 << 24)) return false;
+
+    size_t row_bytes = ((size_t)w * (bpp / 8) + 3) & ~(size_t)3;
+    if (offset < 14 + hsz || offset > size || (size - offset) / row_bytes < (size_t)h) return false;
+
+    T lut[256]; //8-bitGզL -> Ƕ
+    if (bpp == 8) {
+        size_t psize = (offset - 14 - hsz) / 4;
+        if (psize == 0 || psize > 256) return false;
+        const uint8_t* pal = p + 14 + hsz; //C entry  B G R Od
+        for (size_t i = 0; i < 256; ++i) {
+            int y = i < psize ? (pal[4*i + 2] * 77 + pal[4*i + 1] * 150 + pal[4*i] * 29) >> 8 : 0;
+            lut[i] = gray8_to<T>(y);
+        }
+    }
+
+    if (!is_stbi_target(img, w, h)) img.allocate(w, h, nullptr, PixInit::Uninit); //wtnNgih
+    for (int y = 0; y < h; ++y) {
+        const uint8_t* MMIP_RESTRICT s = p + offset + (size_t)(bottom_up ? h - 1 - y : y) * row_bytes;
+        T* MMIP_RESTRICT d = img.row(y).data();
+        if (bpp == 8) {
+            for (int x = 0; x < w; ++x) d[x] = lut[s[x]];
+        } else {
+            const int n = bpp / 8; //B G R (A)Aalpha vTǶ
+            for (int x = 0; x < w; ++x, s += n) d[x] = gray8_to<T>((s[2] * 77 + s[1] * 150 + s[0] * 29) >> 8);
+        }
+    }
     return true;
 }
 
@@ -61,72 +656,279 @@ bool read_raw(const string& path, GrayImage& img){
 //     int *channels_in_file,  // [out] ϹڦXӳqD
 //     int desired_channels    // [in]  nDXXӳqD
 // );
+// 16-bit  stbi_load_16]16-bit PNG/PNM ȫOdA8-bit ӷ|Qj v*257^Ffloat  HDR  stbi_loadfAL 16-bit A 65535A׶} stbi_loadf  LDR  gamma ഫ
 
-bool read_gray_any(const string& path, GrayImage& img){
+// jpeg_scale = 2/4/8GJPEG bѽXY 1/2B1/4B1/8]stb  4x4/2x2/u DC Yp IDCTA٤Uj IDCT M upsampling^A
+// eLiFL榡vT
+template <typename T>
+bool read_gray_any(const string& path, GrayImageT<T>& img, int jpeg_scale = 1){
     int comp,w,h;
-    unsigned char* data = stbi_load(path.c_str(), &w, &h, &comp, STBI_grey); //stbiǶ}CAcharint => intOŶ
+    auto file = map_stbi_input(path);
+    if (!file) return false;
+    if (read_bmp_gray(*file, img)) return true; //`Y BMP @ŪAl浹 stb
+    StbiArenaPool::Lease arena = StbiArenaPool::instance().lease(); //ѽXȦsbo arena WAreturn ٦^h
+    StbiArenaScope arena_scope(arena.get());
+    const stbi_uc* buf = file->data();
+    int len = (int)file->size();
+    void* data = nullptr;
+    stbi_jpeg_set_scale_denom_thread(jpeg_scale); //uvTo thread U@ѽX
+    struct ScaleReset { ~ScaleReset() { stbi_jpeg_set_scale_denom_thread(1); } } scale_reset;
+    bool hdr = std::is_floating_point_v<T> && stbi_is_hdr_from_memory(buf, len);
+    bool convert16 = std::is_floating_point_v<T> && !hdr; //float  LDR ӷGŪ 16-bit A
+    // تv]IsݨSwtnɥYۤvt^Astb ̲׿XѶih]convert16 t~AΡ^
+    StbiOutputSlot slot;
+    int pw, ph, pc;
+    if (!convert16 && stbi_decoded_size(*file, jpeg_scale, pw, ph, pc)) {
+        if (!is_stbi_target(img, pw, ph)) allocate_stbi_target(img, pw, ph);
+        slot = stbi_output_slot(img);
+    }
+    {
+        StbiOutputScope output_scope(slot.ptr ? &slot : nullptr);
+        if constexpr (std::is_same_v<T, uint8_t>) {
+            data = stbi_load_from_memory(buf, len, &w, &h, &comp, STBI_grey); //stbiǶ}CAcharint => intOŶ
+        } else if constexpr (std::is_same_v<T, uint16_t>) {
+            data = stbi_load_16_from_memory(buf, len, &w, &h, &comp, STBI_grey);
+        } else if (hdr) {
+            data = stbi_loadf_from_memory(buf, len, &w, &h, &comp, STBI_grey);
+        } else {
+            data = stbi_load_16_from_memory(buf, len, &w, &h, &comp, STBI_grey);
+        }
+    }
     if (!data) {
         cerr << "stbi_load " << path << " failed" << endl;
         return false;
     }
-    img.w = w; img.h = h;
-    img.pix.assign(data, data + img.w * img.h); //q data ж}l data + img.w * img.h AƻsoqO餺e img.pixC
-    stbi_image_free(data); 
+    if (data == slot.ptr) { //̲׿XNbv̡Gƻs
+        img.adopt(std::move(img.pix), w, h, w);
+        return true;
+    }
+    // ̲׿Xb arena W]ت buffer Q buffer BΨSؤo^Gƻsivۤv buffer
+    if (img.w != w || img.h != h || !img.pix.data() || img.pix.shared()) img.allocate(w, h, nullptr, PixInit::Uninit);
+    for (int y = 0; y < h; ++y) {
+        T* MMIP_RESTRICT d = img.row(y).data();
+        if (convert16) {
+            const stbi_us* MMIP_RESTRICT s = (const stbi_us*)data + (size_t)y * w;
+            for (int x = 0; x < w; ++x) d[x] = s[x] / 65535.0f;
+        } else {
+            memcpy(d, (const T*)data + (size_t)y * w, (size_t)w * sizeof(T));
+        }
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+// PGM Y "P5\n<w> <h>\n<maxval>\n"A to_chars giIsݪ buffer]gL iostream/locale^A^Ǫ
+constexpr size_t kPgmHeaderMax = 40;
+inline size_t pgm_header(char (&buf)[kPgmHeaderMax], int w, int h, int maxval) {
+    char* p = buf;
+    char* end = buf + kPgmHeaderMax;
+    *p++ = 'P'; *p++ = '5'; *p++ = '\n';
+    p = to_chars(p, end, w).ptr;   *p++ = ' ';
+    p = to_chars(p, end, h).ptr;   *p++ = '\n';
+    p = to_chars(p, end, maxval).ptr; *p++ = '\n';
+    return size_t(p - buf);
+}
+
+#ifndef _WIN32
+// 8-bit v iovecGY@qFstride == w ɹ@qA_hCC@q]LɻϡAt~ƻs^
+inline void pgm_iovecs(vector<iovec>& iov, const void* header, size_t header_len, const ImageView& img) {
+    iov.push_back({(void*)header, header_len});
+    if (img.stride == img.w || img.h == 1) {
+        iov.push_back({(void*)img.data, (size_t)img.w * img.h});
+    } else {
+        for (int y = 0; y < img.h; ++y) iov.push_back({(void*)img.row(y).data(), (size_t)img.w});
+    }
+}
+
+// writev gGC̦h IOV_MAX qAgJɱq_mۼg
+inline bool writev_all(int fd, iovec* iov, size_t n) {
+    constexpr size_t kMaxIov = 1024;
+    while (n > 0) {
+        ssize_t r = ::writev(fd, iov, (int)min(n, kMaxIov));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        size_t done = (size_t)r;
+        while (n > 0 && done >= iov->iov_len) { done -= iov->iov_len; ++iov; --n; }
+        if (n > 0) { iov->iov_base = (char*)iov->iov_base + done; iov->iov_len -= done; }
+    }
     return true;
 }
+#endif
 
-bool write_pgm(const string& path, const GrayImage& img) {
+// P5Gmaxval 255 ɤ@ sample 1 byteF16-bit  maxval 65535BC sample 2 bytes big-endian]PGM Ww^
+// POSIX WO open + @ writev]Y + ^+ closeF16-bit i big-endian Ag
+template <typename Img, typename T = pixel_of<Img>>
+bool write_pgm(const string& path, const Img& src) {
+    static_assert(std::is_integral_v<T>, "float vХ write_pfm");
+    ImageViewT<T> img = src;
+    char header[kPgmHeaderMax];
+    size_t header_len = pgm_header(header, img.w, img.h, (int)PixelTraits<T>::max);
+    vector<uint8_t> be(sizeof(T) > 1 ? (size_t)img.w * img.h * 2 : 0);
+    if constexpr (sizeof(T) > 1) {
+        uint8_t* d = be.data();
+        for (int y = 0; y < img.h; ++y) {
+            const T* s = img.row(y).data();
+            for (int x = 0; x < img.w; ++x, d += 2) { d[0] = uint8_t(s[x] >> 8); d[1] = uint8_t(s[x]); }
+        }
+    }
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        cerr << "cannot write: " << path << "\n";
+        return false;
+    }
+    vector<iovec> iov;
+    if constexpr (sizeof(T) == 1) {
+        pgm_iovecs(iov, header, header_len, img);
+    } else {
+        iov.push_back({header, header_len});
+        iov.push_back({be.data(), be.size()});
+    }
+    bool ok = writev_all(fd, iov.data(), iov.size());
+    ok = (::close(fd) == 0) && ok;
+    if (!ok) cerr << "write failed: " << path << "\n";
+    return ok;
+#else
     ofstream f(path, ios::binary);  //Xɮbinary
     if (!f) { 
         cerr << "cannot write: " << path << "\n"; 
         return false; 
     }
-    f << "P5\n" << img.w << " " << img.h << "\n255\n";
-    f.write((const char*)img.pix.data(), img.w * img.h);
+    f.write(header, header_len);
+    if constexpr (sizeof(T) == 1) {
+        for (int y = 0; y < img.h; ++y) f.write((const char*)img.row(y).data(), img.w); //ugCCe w  sampleAɻϤX
+    } else {
+        f.write((const char*)be.data(), be.size());
+    }
     return (bool)f;
+#endif
 }
 
-void print_center10(const GrayImage& img,const string& tag){
-    for (int y = img.h / 2 - 5; y < img.h / 2 + 5; y++){
-        for (int x = img.w / 2 - 5; x < img.w / 2 + 5; x++){
-            cout << setw(3) << (int)img.at(x,y) << (x == img.w/2+4 ? '\n' : ' '); //setw(3)]wCӭȳ榡Ƭ 3 reסA(int)uint8_tনintX
+// PFM Ƕ]"Pf"^Gscale tN little-endianACѤUWs
+template <typename Img>
+bool write_pfm(const string& path, const Img& src) {
+    ImageViewT<float> img = src;
+    ofstream f(path, ios::binary);
+    if (!f) { 
+        cerr << "cannot write: " << path << "\n"; 
+        return false; 
+    }
+    f << "Pf\n" << img.w << " " << img.h << "\n-1.0\n";
+    for (int y = img.h - 1; y >= 0; --y) {
+        f.write((const char*)img.row(y).data(), (size_t)img.w * sizeof(float));
+    }
+    return (bool)f;
+}
+
+template <typename Img, typename T = pixel_of<Img>>
+void print_center10(const Img& src,const string& tag, ostream& out = cout){
+    ImageViewT<T> img = src;
+    ImageViewT<T> c = img.crop(img.w / 2 - 5, img.h / 2 - 5, 10, 10); // 10x10 ϡAƻs
+    auto value = [](T p) { if constexpr (std::is_integral_v<T>) return (int)p; else return p; }; //(int) pixel নintX
+    for (int y = 0; y < c.h; y++){
+        Span<const T> r = c.row(y);
+        for (int x = 0; x < c.w; x++){
+            out << setw(3) << value(r[x]) << (x == c.w-1 ? '\n' : ' '); //setw(3)]wCӭȳ榡Ƭ 3 re
         }
-        cout << endl;
+        out << endl;
     }
 
     ofstream csv(string("results/") + tag + "_center10.csv");
 
-    for (int y = img.h / 2 - 5; y < img.h / 2 + 5; y++) {
-        for (int x = img.w / 2 - 5; x < img.w / 2 + 5; x++) {
-            csv << (int)img.at(x,y) << (x == img.w/2+4  ? '\n' : ',');
+    for (int y = 0; y < c.h; y++) {
+        Span<const T> r = c.row(y);
+        for (int x = 0; x < c.w; x++) {
+            csv << value(r[x]) << (x == c.w-1  ? '\n' : ',');
         }
     }
 }
 
 //(b)Image enhancement toolkit
-GrayImage negative(GrayImage& in) {
-    GrayImage out = in;
-    for (auto& p : out.pix) {
-        p = 255 - p; //Ϭ
+// IBⳣY GrayImageT / ImageViewTAX@߬Ostm GrayImageT]C^FJiHOΥ~ buffer
+// ҦO@ˡAH PixelTraits<T>::max סF8-bit GM쥻v pixel p⧹ۦP
+
+// C pixel M fC8-bit u 256 ؿJAndAC pixel uѤ@d
+template <typename T, typename F>
+static GrayImageT<T> map_pixels(const ImageViewT<T>& in, F f, Arena* arena) {
+    GrayImageT<T> out;
+    out.allocate(in.w, in.h, arena, PixInit::Uninit);
+    if constexpr (sizeof(T) == 1) {
+        T lut[256];
+        for (int p = 0; p < 256; ++p) lut[p] = f((T)p);
+        for (int y = 0; y < in.h; ++y) {
+            const T* MMIP_RESTRICT s = in.row(y).data();
+            T* MMIP_RESTRICT d = out.row(y).data();
+            for (int x = 0; x < in.w; ++x) {
+                d[x] = lut[s[x]];
+            }
+        }
+    } else {
+        for (int y = 0; y < in.h; ++y) {
+            const T* MMIP_RESTRICT s = in.row(y).data();
+            T* MMIP_RESTRICT d = out.row(y).data();
+            for (int x = 0; x < in.w; ++x) {
+                d[x] = f(s[x]);
+            }
+        }
     }
     return out;
 }
 
-GrayImage log_transform(const GrayImage& in){
-    GrayImage out = in;
-    double c = 255.0 / log(256.0); 
-    for (auto& p : out.pix) {
-        p = static_cast<uint8_t>(c * log(1 + p)); //GiWX 0V255AΤOơC` static_cast<uint8_t> ⥦^ 0V255 ƫA
+template <typename Img, typename T = pixel_of<Img>>
+GrayImageT<T> negative(const Img& src, Arena* arena = nullptr) {
+    ImageViewT<T> in = src;
+    if constexpr (std::is_floating_point_v<T>) {
+        return map_pixels(in, [](T p) { return T(PixelTraits<T>::max - p); }, arena);
+    } else {
+        // ƫO׬O 1 bitsAmax - p == p ^ maxAH byte  xor
+        GrayImageT<T> out;
+        out.allocate(in.w, in.h, arena, PixInit::Uninit);
+        const int row_bytes = in.w * (int)sizeof(T);
+#ifdef MMIP_SSE2
+        const __m128i ones = _mm_set1_epi8((char)0xFF);
+        const bool padded = rows_padded16(in);
+#endif
+        for (int y = 0; y < in.h; ++y) {
+            const uint8_t* MMIP_RESTRICT s = (const uint8_t*)in.row(y).data();
+            uint8_t* MMIP_RESTRICT d = (uint8_t*)out.row(y).data();
+            int x = 0;
+#ifdef MMIP_SSE2
+            if (padded) { //ɻBAS
+                for (; x < row_bytes; x += 16) {
+                    __m128i v = _mm_load_si128((const __m128i*)(s + x));
+                    _mm_store_si128((__m128i*)(d + x), _mm_xor_si128(v, ones));
+                }
+            } else {
+                for (; x + 16 <= row_bytes; x += 16) {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(s + x));
+                    _mm_store_si128((__m128i*)(d + x), _mm_xor_si128(v, ones));
+                }
+            }
+#endif
+            for (; x < row_bytes; ++x) {
+                d[x] = 255 - s[x]; //Ϭ
+            }
+        }
+        return out;
     }
-    return out;
 }
 
-GrayImage gamma_transform(const GrayImage& in, double gamma){
-    GrayImage out = in;
-    for (auto& p : out.pix) {
-        p = static_cast<uint8_t>(255.0 * pow(p / 255.0, gamma)); 
-    }
-    return out;
+template <typename Img, typename T = pixel_of<Img>>
+GrayImageT<T> log_transform(const Img& src, Arena* arena = nullptr){
+    double c = PixelTraits<T>::max / log(PixelTraits<T>::max + 1); 
+    return map_pixels(ImageViewT<T>(src), [c](T p) {
+        return to_pixel<T>(c * log(1 + p)); //GiWXdAΤOơCƫO static_cast ⥦^ƫA
+    }, arena);
+}
+
+template <typename Img, typename T = pixel_of<Img>>
+GrayImageT<T> gamma_transform(const Img& src, double gamma, Arena* arena = nullptr){
+    const double m = PixelTraits<T>::max;
+    return map_pixels(ImageViewT<T>(src), [m, gamma](T p) {
+        return to_pixel<T>(m * pow(p / m, gamma)); 
+    }, arena);
 }
 
 //(c)Image downsampling and upsampling
@@ -134,29 +936,56 @@ static inline double map_coord(int x, int src_len, int dst_len) { //
     return ((x + 0.5) * (double)src_len / (double)dst_len) - 0.5;
 }
 
-GrayImage resize_nearest(const GrayImage& in, int newW, int newH){
-    GrayImage out;
-    out.w = newW; out.h = newH;
-    out.pix.resize(newW * newH);
+// C@ӷ x uM榳A⦨AC@C@ΡFC@Cu@ӷC
+template <typename Img, typename T = pixel_of<Img>>
+GrayImageT<T> resize_nearest(const Img& src, int newW, int newH, Arena* arena = nullptr){
+    ImageViewT<T> in = src;
+    GrayImageT<T> out;
+    out.allocate(newW, newH, arena, PixInit::Uninit);
 
+    vector<int> sxs(newW);
+    for (int x = 0; x < newW; ++x) {
+        int sx = static_cast<int>(lround(map_coord(x, in.w, newW)));
+        if (sx < 0) sx = 0;
+        if (sx >= in.w) sx = in.w - 1;
+        sxs[x] = sx;
+    }
+    const int* MMIP_RESTRICT xs = sxs.data();
     for (int y = 0; y < newH; ++y) {
         int sy = static_cast<int>(lround(map_coord(y, in.h, newH))); //|ˤJ
         if (sy < 0) sy = 0;
         if (sy >= in.h) sy = in.h - 1;
+        const T* MMIP_RESTRICT s = in.row(sy).data();
+        T* MMIP_RESTRICT d = out.row(y).data();
         for (int x = 0; x < newW; ++x) {
-            int sx = static_cast<int>(lround(map_coord(x, in.w, newW)));
-            if (sx < 0) sx = 0;
-            if (sx >= in.w) sx = in.w - 1;
-            out.at(x, y) = in.at(sx, sy);
+            d[x] = s[xs[x]];
         }
     }
     return out;
 }
 
-GrayImage resize_bilinear(const GrayImage& in, int newW, int newH){
-    GrayImage out;
-    out.w = newW; out.h = newH;
-    out.pix.resize(newW * newH);
+template <typename Img, typename T = pixel_of<Img>>
+GrayImageT<T> resize_bilinear(const Img& src, int newW, int newH, Arena* arena = nullptr){
+    ImageViewT<T> in = src;
+    GrayImageT<T> out;
+    out.allocate(newW, newH, arena, PixInit::Uninit);
+
+    vector<int> sx0s(newW), sx1s(newW);
+    vector<double> dxs(newW);
+    for (int x = 0; x < newW; ++x) {
+        double sx = map_coord(x, in.w, newW);
+        int sx0 = static_cast<int>(floor(sx));
+        int sx1 = sx0 + 1;
+        double dx = sx - sx0;
+        if (sx0 < 0) { sx0 = 0; dx = 0.0; }
+        if (sx1 < 0) { sx1 = 0; }
+        if (sx0 >= in.w) { sx0 = in.w - 1; dx = 0.0; }
+        if (sx1 >= in.w) { sx1 = in.w - 1; }
+        sx0s[x] = sx0; sx1s[x] = sx1; dxs[x] = dx;
+    }
+    const int* MMIP_RESTRICT x0s = sx0s.data();
+    const int* MMIP_RESTRICT x1s = sx1s.data();
+    const double* MMIP_RESTRICT ws = dxs.data();
 
     for (int y = 0; y < newH; ++y) {
         double sy = map_coord(y, in.h, newH);
@@ -167,34 +996,936 @@ GrayImage resize_bilinear(const GrayImage& in, int newW, int newH){
         if (sy1 < 0) { sy1 = 0; }
         if (sy0 >= in.h) { sy0 = in.h - 1; dy = 0.0; }
         if (sy1 >= in.h) { sy1 = in.h - 1; }
+        const T* MMIP_RESTRICT r0 = in.row(sy0).data();
+        const T* MMIP_RESTRICT r1 = in.row(sy1).data();
+        T* MMIP_RESTRICT d = out.row(y).data();
 
         for (int x = 0; x < newW; ++x) {
-            double sx = map_coord(x, in.w, newW);
-            int sx0 = static_cast<int>(floor(sx));
-            int sx1 = sx0 + 1;
-            double dx = sx - sx0;
-            if (sx0 < 0) { sx0 = 0; dx = 0.0; }
-            if (sx1 < 0) { sx1 = 0; }
-            if (sx0 >= in.w) { sx0 = in.w - 1; dx = 0.0; }
-            if (sx1 >= in.w) { sx1 = in.w - 1; }
+            double dx = ws[x];
 
             //uʴ
-            double p00 = in.at(sx0, sy0);
-            double p10 = in.at(sx1, sy0);
-            double p01 = in.at(sx0, sy1);
-            double p11 = in.at(sx1, sy1);
+            double p00 = r0[x0s[x]];
+            double p10 = r0[x1s[x]];
+            double p01 = r1[x0s[x]];
+            double p11 = r1[x1s[x]];
             double pxy = p00 * (1 - dx) * (1 - dy) +
                          p10 * dx * (1 - dy) +
                          p01 * (1 - dx) * dy +
                          p11 * dx * dy;
-            out.at(x, y) = static_cast<uint8_t>(lround(pxy));
+            if constexpr (std::is_integral_v<T>) d[x] = static_cast<T>(lround(pxy));
+            else d[x] = static_cast<T>(pxy);
         }
     }
     return out;
 }
 
+//(d)Multi-channel images
+// mvH planar]structure-of-arrays^sGCӳqDO@iWߡBC GrayImageT
+// Ƕ kernel ʤʦavMΡA qD  ǶAhj̨Sv pixel P_qD
+template <typename T>
+struct PlanarImageT {
+    using value_type = T;
+    vector<GrayImageT<T>> planes; // 1 = grayB2 = gray+alphaB3 = RGBB4 = RGBA]M stbi qDǤ@P^
+    int channels() const { return (int)planes.size(); }
+    int w() const { return planes.empty() ? 0 : planes[0].w; }
+    int h() const { return planes.empty() ? 0 : planes[0].h; }
+};
+using PlanarImage = PlanarImageT<uint8_t>;
+
+// OdlqDŪɡ] STBI_grey^AJɤ@ interleaved U
+template <typename T>
+bool read_planar_any(const string& path, PlanarImageT<T>& img){
+    static_assert(!std::is_floating_point_v<T>, "planar Ūɥu䴩 8/16-bit");
+    int comp,w,h;
+    auto file = map_stbi_input(path);
+    if (!file) return false;
+    StbiArenaPool::Lease arena = StbiArenaPool::instance().lease();
+    StbiArenaScope arena_scope(arena.get());
+    // qDӴNO planarGM read_gray_any @˥tnتA stb Ѷih
+    GrayImageT<T> target;
+    StbiOutputSlot slot;
+    int pw, ph, pc;
+    if (stbi_decoded_size(*file, 1, pw, ph, pc) && pc == 1) {
+        allocate_stbi_target(target, pw, ph);
+        slot = stbi_output_slot(target);
+    }
+    void* data = nullptr;
+    {
+        StbiOutputScope output_scope(slot.ptr ? &slot : nullptr);
+        if constexpr (sizeof(T) == 1) data = stbi_load_from_memory(file->data(), (int)file->size(), &w, &h, &comp, 0);
+        else data = stbi_load_16_from_memory(file->data(), (int)file->size(), &w, &h, &comp, 0);
+    }
+    if (!data) {
+        cerr << "stbi_load " << path << " failed" << endl;
+        return false;
+    }
+    if (data == slot.ptr) {
+        target.adopt(std::move(target.pix), w, h, w);
+        img.planes.assign(1, std::move(target));
+        return true;
+    }
+    img.planes.assign(comp, GrayImageT<T>());
+    for (int c = 0; c < comp; ++c) { //@Bz@ӥAӷH comp ZŪ
+        GrayImageT<T>& p = img.planes[c];
+        p.allocate(w, h, nullptr, PixInit::Uninit);
+        for (int y = 0; y < h; ++y) {
+            const T* MMIP_RESTRICT s = (const T*)data + (size_t)y * w * comp + c;
+            T* MMIP_RESTRICT d = p.row(y).data();
+            for (int x = 0; x < w; ++x) {
+                d[x] = s[(size_t)x * comp];
+            }
+        }
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+// CӥU}@]P@ӦǶ kernel] 0 ӥѩIsݦۤv]^AS@θ
+// ҡGmap_planes(img, [](const GrayImage& p) { return resize_bilinear(p, 128, 128); })
+template <typename T, typename F>
+PlanarImageT<T> map_planes(const PlanarImageT<T>& in, F kernel) {
+    PlanarImageT<T> out;
+    out.planes.resize(in.planes.size());
+    vector<thread> workers;
+    for (size_t c = 1; c < in.planes.size(); ++c) {
+        workers.emplace_back([&, c] { out.planes[c] = kernel(in.planes[c]); });
+    }
+    if (!in.planes.empty()) out.planes[0] = kernel(in.planes[0]);
+    for (auto& t : workers) t.join();
+    return out;
+}
+
+// 1 qDg P5B3 qDg P6AL]gray+alphaBRGBA^g P7 (PAM)Fgɮɤ~vC^ interleaved
+template <typename T>
+bool write_pnm(const string& path, const PlanarImageT<T>& img) {
+    static_assert(std::is_integral_v<T>, "PNM u䴩 8/16-bit");
+    const int n = img.channels(), w = img.w(), h = img.h();
+    if (n == 1) return write_pgm(path, img.planes[0]);
+    ofstream f(path, ios::binary);
+    if (!f) { 
+        cerr << "cannot write: " << path << "\n"; 
+        return false; 
+    }
+    const int maxval = (int)PixelTraits<T>::max;
+    if (n == 3) {
+        f << "P6\n" << w << " " << h << "\n" << maxval << "\n";
+    } else {
+        f << "P7\nWIDTH " << w << "\nHEIGHT " << h << "\nDEPTH " << n << "\nMAXVAL " << maxval
+          << "\nTUPLTYPE " << (n == 2 ? "GRAYSCALE_ALPHA" : "RGB_ALPHA") << "\nENDHDR\n";
+    }
+    vector<uint8_t> row((size_t)w * n * sizeof(T));
+    for (int y = 0; y < h; ++y) {
+        for (int c = 0; c < n; ++c) {
+            const T* s = img.planes[c].row(y).data();
+            for (int x = 0; x < w; ++x) {
+                size_t i = (size_t)x * n + c;
+                if constexpr (sizeof(T) == 1) row[i] = s[x];
+                else { row[2*i] = uint8_t(s[x] >> 8); row[2*i+1] = uint8_t(s[x]); } //16-bit @ˬO big-endian
+            }
+        }
+        f.write((const char*)row.data(), row.size());
+    }
+    return (bool)f;
+}
+
+//(e)Tiled storage
+// t@xs覡G 64x64  tileAC tile  row-major ssAtile A row-major ƦC
+// V 2D F쪺s]resize_bilinear  sy0/sy1 C^bP@ tile ̡AeϤACC@ pageB@ miss TLB
+template <typename T>
+struct TiledImageT {
+    using value_type = T;
+    static constexpr int kTileShift = 6;
+    static constexpr int kTile = 1 << kTileShift; // 64x64  pixelA8-bit n 4 KB = @ page
+    static constexpr int kTileMask = kTile - 1;
+    static constexpr size_t kTileSize = (size_t)kTile * kTile;
+
+    int w{0};
+    int h{0};
+    int tiles_x{0};
+    int tiles_y{0};
+    PixelBuffer<T> pix; // kBU䤣 64  tile ]tjpAWX w/h eO
+
+    T* tile(int tx, int ty) { return pix.mutable_data() + ((size_t)ty * tiles_x + tx) * kTileSize; }
+    const T* tile(int tx, int ty) const { return pix.data() + ((size_t)ty * tiles_x + tx) * kTileSize; }
+    T& at(int x, int y) { return tile(x >> kTileShift, y >> kTileShift)[(y & kTileMask) * kTile + (x & kTileMask)]; }
+    const T& at(int x, int y) const { return tile(x >> kTileShift, y >> kTileShift)[(y & kTileMask) * kTile + (x & kTileMask)]; }
+
+    // kernel ΪkG y Cbu 0  tile v_I +  x ۹󥦪첾A̦UۥuM y  x AiH}
+    const T* row_base(int y) const { return pix.data() + (size_t)(y >> kTileShift) * tiles_x * kTileSize + (size_t)(y & kTileMask) * kTile; }
+    static size_t col_offset(int x) { return (size_t)(x >> kTileShift) * kTileSize + (x & kTileMask); }
+
+    void allocate(int W, int H, Arena* arena = nullptr, PixInit init = PixInit::Zero) {
+        w = W; h = H;
+        tiles_x = (W + kTileMask) >> kTileShift;
+        tiles_y = (H + kTileMask) >> kTileShift;
+        size_t n = (size_t)tiles_x * tiles_y * kTileSize;
+        pix = PixelBuffer<T>(n, arena, init);
+    }
+
+    // Ҧ tile ݦ@ie 64B tiles*64 vAbG pixel mIB⪽
+    ImageViewT<T> tile_column() const { return {pix.data(), kTile, (int)(pix.size() / kTile), kTile}; }
+};
+using TiledImage = TiledImageT<uint8_t>;
+
+// row-major -> tiledG@Bz@ tile rowAӷC@CqksŪAgU tile P@C
+template <typename Img, typename T = pixel_of<Img>>
+TiledImageT<T> to_tiled(const Img& src, Arena* arena = nullptr) {
+    constexpr int kTile = TiledImageT<T>::kTile;
+    ImageViewT<T> in = src;
+    TiledImageT<T> out;
+    out.allocate(in.w, in.h, arena, PixInit::Uninit);
+    for (int y = 0; y < in.h; ++y) {
+        const T* s = in.row(y).data();
+        int ty = y / kTile, r = y % kTile;
+        for (int tx = 0; tx < out.tiles_x; ++tx) {
+            int x0 = tx * kTile, n = min(kTile, in.w - x0);
+            memcpy(out.tile(tx, ty) + (size_t)r * kTile, s + x0, n * sizeof(T));
+        }
+    }
+    return out;
+}
+
+// tiled -> row-major
+template <typename T>
+GrayImageT<T> from_tiled(const TiledImageT<T>& in, Arena* arena = nullptr) {
+    constexpr int kTile = TiledImageT<T>::kTile;
+    GrayImageT<T> out;
+    out.allocate(in.w, in.h, arena, PixInit::Uninit);
+    for (int y = 0; y < in.h; ++y) {
+        T* d = out.row(y).data();
+        int ty = y / kTile, r = y % kTile;
+        for (int tx = 0; tx < in.tiles_x; ++tx) {
+            int x0 = tx * kTile, n = min(kTile, in.w - x0);
+            memcpy(d + x0, in.tile(tx, ty) + (size_t)r * kTile, n * sizeof(T));
+        }
+    }
+    return out;
+}
+
+// IBM pixel mLA tile buffer ]쥻Ƕ kernelFX stride n]O 64Abuffer ˷h^ tile ƦC
+// ҡGmap_tiles(t, [](const ImageView& v) { return negative(v); })
+template <typename T, typename F>
+TiledImageT<T> map_tiles(const TiledImageT<T>& in, F kernel) {
+    static_assert(TiledImageT<T>::kTile % (kRowAlign / sizeof(T)) == 0, "tile eץOCơAX stride ~|nO 64");
+    GrayImageT<T> flat = kernel(in.tile_column());
+    TiledImageT<T> out;
+    out.w = in.w; out.h = in.h;
+    out.tiles_x = in.tiles_x; out.tiles_y = in.tiles_y;
+    out.pix = std::move(flat.pix);
+    return out;
+}
+
+// tile-aware resizeG@񺡤@ӿX tileAoqX쪺ӷubּƴX tile W
+// CӿX tile  64 yХnAhuѬdMȡFGM row-major v pixel ۦP
+template <typename T>
+TiledImageT<T> resize_nearest(const TiledImageT<T>& in, int newW, int newH, Arena* arena = nullptr){
+    constexpr int kTile = TiledImageT<T>::kTile;
+    TiledImageT<T> out;
+    out.allocate(newW, newH, arena, PixInit::Uninit);
+    size_t sxo[kTile];
+    for (int ty = 0; ty < out.tiles_y; ++ty) {
+        for (int tx = 0; tx < out.tiles_x; ++tx) {
+            T* d = out.tile(tx, ty);
+            int x0 = tx * kTile, nx = min(kTile, newW - x0);
+            int y0 = ty * kTile, ny = min(kTile, newH - y0);
+            for (int i = 0; i < nx; ++i) {
+                int sx = static_cast<int>(lround(map_coord(x0 + i, in.w, newW)));
+                sxo[i] = TiledImageT<T>::col_offset(min(max(sx, 0), in.w - 1));
+            }
+            for (int j = 0; j < ny; ++j) {
+                int sy = static_cast<int>(lround(map_coord(y0 + j, in.h, newH))); //|ˤJ
+                sy = min(max(sy, 0), in.h - 1);
+                const T* MMIP_RESTRICT s = in.row_base(sy);
+                for (int i = 0; i < nx; ++i) {
+                    d[j * kTile + i] = s[sxo[i]];
+                }
+            }
+        }
+    }
+    return out;
+}
+
+template <typename T>
+TiledImageT<T> resize_bilinear(const TiledImageT<T>& in, int newW, int newH, Arena* arena = nullptr){
+    constexpr int kTile = TiledImageT<T>::kTile;
+    TiledImageT<T> out;
+    out.allocate(newW, newH, arena, PixInit::Uninit);
+    size_t sx0o[kTile], sx1o[kTile];
+    double dxs[kTile];
+    for (int ty = 0; ty < out.tiles_y; ++ty) {
+        for (int tx = 0; tx < out.tiles_x; ++tx) {
+            T* d = out.tile(tx, ty);
+            int x0 = tx * kTile, nx = min(kTile, newW - x0);
+            int y0 = ty * kTile, ny = min(kTile, newH - y0);
+            for (int i = 0; i < nx; ++i) { //M row-major P˪ɳBz
+                double sx = map_coord(x0 + i, in.w, newW);
+                int sx0 = static_cast<int>(floor(sx));
+                int sx1 = sx0 + 1;
+                double dx = sx - sx0;
+                if (sx0 < 0) { sx0 = 0; dx = 0.0; }
+                if (sx1 < 0) { sx1 = 0; }
+                if (sx0 >= in.w) { sx0 = in.w - 1; dx = 0.0; }
+                if (sx1 >= in.w) { sx1 = in.w - 1; }
+                sx0o[i] = TiledImageT<T>::col_offset(sx0); sx1o[i] = TiledImageT<T>::col_offset(sx1); dxs[i] = dx;
+            }
+            for (int j = 0; j < ny; ++j) {
+                double sy = map_coord(y0 + j, in.h, newH);
+                int sy0 = static_cast<int>(floor(sy));
+                int sy1 = sy0 + 1;
+                double dy = sy - sy0;
+                if (sy0 < 0) { sy0 = 0; dy = 0.0; }
+                if (sy1 < 0) { sy1 = 0; }
+                if (sy0 >= in.h) { sy0 = in.h - 1; dy = 0.0; }
+                if (sy1 >= in.h) { sy1 = in.h - 1; }
+                const T* MMIP_RESTRICT r0 = in.row_base(sy0);
+                const T* MMIP_RESTRICT r1 = in.row_base(sy1);
+                for (int i = 0; i < nx; ++i) {
+                    double dx = dxs[i];
+                    double p00 = r0[sx0o[i]];
+                    double p10 = r0[sx1o[i]];
+                    double p01 = r1[sx0o[i]];
+                    double p11 = r1[sx1o[i]];
+                    double pxy = p00 * (1 - dx) * (1 - dy) +
+                                 p10 * dx * (1 - dy) +
+                                 p01 * (1 - dx) * dy +
+                                 p11 * dx * dy;
+                    if constexpr (std::is_integral_v<T>) d[j * kTile + i] = static_cast<T>(lround(pxy));
+                    else d[j * kTile + i] = static_cast<T>(pxy);
+                }
+            }
+        }
+    }
+    return out;
+}
+
+//(f)Input stage
+// ij JPEG ѽXGɮױa DRI]restart marker^ɡAstb XU϶A̦h width() 浹oӦlA
+// CgiۤvXC MCU 
+// ӵ{@Τ@ helper thread]hardware_concurrency - 1 ^AAC scan } threadFIsݦۤv]@_A
+// helper bO DecodeStage worker  JPEG ɡAIsݴNۤvѤUA` thread Ƥ|H worker Ƭۭ
+class ParallelForPool {
+public:
+    explicit ParallelForPool(int helpers) {
+        for (int i = 0; i < helpers; ++i) threads_.emplace_back([this] { run(); });
+    }
+    ~ParallelForPool() {
+        {
+            lock_guard<mutex> lk(m_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+    ParallelForPool(const ParallelForPool&) = delete;
+    ParallelForPool& operator=(const ParallelForPool&) = delete;
+
+    int width() const { return (int)threads_.size() + 1; } // stb  thread ơ]tIsݡ^
+
+    void parallel_for(int count, void (*task)(void*, int), void* arg) {
+        Batch b{task, arg, count};
+        if (!threads_.empty()) {
+            lock_guard<mutex> lk(m_);
+            queue_.push_back(&b);
+        }
+        work_cv_.notify_all();
+        int finished = drain(b);
+        unique_lock<mutex> lk(m_);
+        auto it = find(queue_.begin(), queue_.end(), &b);
+        if (it != queue_.end()) queue_.erase(it);
+        b.done += finished;
+        //helper ٮ b Юɤ}]b bo stack frame W^
+        done_cv_.wait(lk, [&] { return b.done == b.count && b.users == 0; });
+    }
+
+    static void hook(void* user, int count, void (*task)(void*, int), void* arg) {
+        static_cast<ParallelForPool*>(user)->parallel_for(count, task, arg);
+    }
+
+private:
+    struct Batch {
+        void (*task)(void*, int);
+        void* arg;
+        int count;
+        atomic<int> next{0};
+        int done{0};  //HUӥ m_ O@
+        int users{0}; //bo媺 helper 
+    };
+
+    static int drain(Batch& b) {
+        int finished = 0;
+        for (int i; (i = b.next.fetch_add(1)) < b.count; ++finished) b.task(b.arg, i);
+        return finished;
+    }
+
+    void run() {
+        unique_lock<mutex> lk(m_);
+        for (;;) {
+            work_cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+            if (stop_) return;
+            Batch* b = queue_.front();
+            if (b->next.load() >= b->count) { //Q⨫FGXCAIsݦ
+                queue_.pop_front();
+                continue;
+            }
+            ++b->users;
+            lk.unlock();
+            int finished = drain(*b);
+            lk.lock();
+            b->done += finished;
+            --b->users;
+            done_cv_.notify_all();
+        }
+    }
+
+    mutex m_;
+    condition_variable work_cv_, done_cv_;
+    deque<Batch*> queue_;
+    bool stop_{false};
+    vector<thread> threads_;
+};
+
+// ѽXGҦJɤ@}lNƦnAѤ@ worker thread m۸ѡFnext() ̡uǡvXGA
+// Isݮ@iN}lBzAŪCѽXѤ]|X]ok = false^AѩIsݨMwnn
+struct DecodeJob {
+    size_t index;   // IsݦۤvsA˱a^
+    string path;
+    bool raw;       // trueGread_raw] spec^FfalseGread_gray_any
+    RawSpec spec;
+    int jpeg_scale; // read_gray_any  JPEG ѽXYpv]1 = ؤo^
+    GrayImage dest{}; // plan_decode ̱ؤowtnXAѽXɭ˥浹 read_gray_anyFRAW t]MgNO pixel^
+};
+
+struct Decoded {
+    size_t index;
+    GrayImage img;
+    bool ok;
+};
+
+class DecodeStage {
+public:
+    // threads <= 0G hardware_concurrencyF|WLɮ׼
+    explicit DecodeStage(vector<DecodeJob> jobs, int threads = 0) : jobs_(std::move(jobs)) {
+        if (threads <= 0) threads = (int)thread::hardware_concurrency();
+        threads = (int)min<size_t>(max(1, threads), max<size_t>(1, jobs_.size()));
+        for (int i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+    DecodeStage(const DecodeStage&) = delete;
+    DecodeStage& operator=(const DecodeStage&) = delete;
+    // ]ҦpYiŪѡ^ɡA٨S}lɮתL
+    ~DecodeStage() {
+        stop_ = true;
+        for (auto& t : workers_) t.join();
+    }
+
+    // U@iѧvFXh^ false
+    bool next(Decoded& out) {
+        unique_lock<mutex> lk(mu_);
+        if (delivered_ == jobs_.size()) return false;
+        ready_.wait(lk, [this] { return !done_.empty(); });
+        out = std::move(done_.front());
+        done_.pop_front();
+        ++delivered_;
+        return true;
+    }
+
+private:
+    void run() {
+        for (;;) {
+            size_t k = next_job_.fetch_add(1);
+            if (k >= jobs_.size() || stop_) return;
+            DecodeJob& job = jobs_[k];
+            Decoded d{job.index, std::move(job.dest), false};
+            d.ok = job.raw ? read_raw(job.path, d.img, job.spec) : read_gray_any(job.path, d.img, job.jpeg_scale);
+            lock_guard<mutex> lk(mu_);
+            done_.push_back(std::move(d));
+            ready_.notify_one();
+        }
+    }
+
+    vector<DecodeJob> jobs_;
+    atomic<size_t> next_job_{0};
+    atomic<bool> stop_{false};
+    mutex mu_;
+    condition_variable ready_;
+    deque<Decoded> done_;
+    size_t delivered_{0};
+    vector<thread> workers_;
+};
+
+// ѽXeWˬdGeWBqDƤWFexpect_w/h > 0 ɤؤon۲š]]ɡAD 512x512 J­˨ 512x512^
+struct InputLimits {
+    int max_w{16384};
+    int max_h{16384};
+    int max_comp{4};
+    int expect_w{0};
+    int expect_h{0};
+};
+
+// YGGѽX᪺e]JPEG w jpeg_scale YpBLi^BɳqDơ]RAW  spec ؤoB1 qD^
+struct ProbeInfo {
+    int w{0};
+    int h{0};
+    int comp{0};
+    int scale{1}; // ڮMΪ JPEG ѽXYpv]L榡BRAW  1^
+};
+
+// uYAѽXGv stbi_info_from_memory]Mgu fault iYX^ARAW  spec ɮפjp
+// XWλ{oɮצLX]æ^ false
+static bool probe_input(const DecodeJob& job, const InputLimits& lim, ProbeInfo& info) {
+    if (job.raw) {
+        std::error_code ec;
+        uintmax_t size = fs::file_size(job.path, ec);
+        size_t need;
+        if (!raw_spec_bytes(job.spec, 1, need)) { //e <= 0 ΤjpGMLX檺J@_CX
+            cerr << job.path << ": invalid RAW size " << job.spec.w << "x" << job.spec.h << " (offset " << job.spec.offset << ")\n";
+            return false;
+        }
+        if (ec || size < need) {
+            cerr << job.path << ": RAW needs " << need << " bytes for " << job.spec.w << "x" << job.spec.h << ", file has " << (ec ? 0 : size) << "\n";
+            return false;
+        }
+        info = {job.spec.w, job.spec.h, 1, 1};
+    } else {
+        auto file = map_stbi_input(job.path);
+        if (!file) return false;
+        if (!stbi_decoded_size(*file, job.jpeg_scale, info.w, info.h, info.comp, &info.scale)) {
+            cerr << job.path << ": not a supported image (" << stbi_failure_reason() << ")\n";
+            return false;
+        }
+    }
+    if (info.w > lim.max_w || info.h > lim.max_h) {
+        cerr << job.path << ": " << info.w << "x" << info.h << " exceeds the " << lim.max_w << "x" << lim.max_h << " limit\n";
+        return false;
+    }
+    if (info.comp > lim.max_comp) {
+        cerr << job.path << ": " << info.comp << " channels, at most " << lim.max_comp << " allowed\n";
+        return false;
+    }
+    if (lim.expect_w > 0 && (info.w != lim.expect_w || info.h != lim.expect_h)) {
+        cerr << job.path << ": " << info.w << "x" << info.h << ", expected " << lim.expect_w << "x" << lim.expect_h << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Ƶ{GJAX檺Nsi rejected]CXAOJĤ@ӴN^B^ falseA@iѽX
+// qLɨ̹ƥѤjpƧǡ]j}lAѽXɳ̫ᤣ|Ѥ@ijϩۡ^A̱ؤotnCiXv]job.dest^A
+// è̳̤j@iwd decode arenaFinfos H job.index 
+static bool plan_decode(vector<DecodeJob>& jobs, const InputLimits& lim, vector<ProbeInfo>& infos, vector<size_t>& rejected) {
+    infos.assign(jobs.size(), ProbeInfo());
+    for (const DecodeJob& job : jobs) {
+        if (!probe_input(job, lim, infos[job.index])) rejected.push_back(job.index);
+    }
+    if (!rejected.empty()) return false;
+
+    auto pixels = [&](const DecodeJob& j) { return (size_t)infos[j.index].w * infos[j.index].h; };
+    stable_sort(jobs.begin(), jobs.end(), [&](const DecodeJob& a, const DecodeJob& b) { return pixels(a) > pixels(b); });
+
+    // arena uѽXȦsAʦGqDX + Ȧs]zlib XWBJPEG qY buffer^FǶXb job.dest W
+    size_t most = 0;
+    for (DecodeJob& job : jobs) {
+        if (job.raw) continue; //RAW MgAgL stb
+        const ProbeInfo& p = infos[job.index];
+        allocate_stbi_target(job.dest, p.w, p.h);
+        most = max(most, (size_t)p.w * p.h * 4 * p.comp + (64u << 10));
+    }
+    StbiArenaPool::instance().reserve(most);
+    return true;
+}
+
+
+//(f)Output stage
+struct PgmJob {
+    string path;
+    GrayImage img;
+};
+
+// @ PGM ڨ|GPosix = v write_pgm]S io_uringBΰ ring ؤ_ӡ^F
+// IoUringPartial = ring bo夤~aAѤU飼 write_pgm]ӧOɮת fallback ^
+enum class BatchPath { Posix, IoUring, IoUringPartial };
+
+static const char* batch_path_name(BatchPath p) {
+    switch (p) {
+    case BatchPath::IoUring: return "io_uring";
+    case BatchPath::IoUringPartial: return "io_uring, then write_pgm after the ring failed";
+    default: return "write_pgm";
+    }
+}
+
+// @ PGM gɡAѪɦW[i failedFS io_uring xNv write_pgmF^ǳoڨ|
+BatchPath write_pgm_batch(vector<PgmJob>& jobs, vector<string>& failed, size_t direct_min = 0);
+
+#ifdef MMIP_IO_URING
+// ̤p io_uring ]ˡ] syscallA̿ liburing^G@ submission ring + @ completion ring
+class IoUring {
+public:
+    ~IoUring() {
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_) munmap(sq_ptr_, sq_size_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool init(unsigned entries, unsigned fixed_files) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd_ < 0) return false;
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) sq_size_ = cq_size_ = max(sq_size_, cq_size_);
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) { sq_ptr_ = nullptr; return false; }
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ptr_ = sq_ptr_;
+        } else {
+            cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED) { cq_ptr_ = nullptr; return false; }
+        }
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        sqes_ = (io_uring_sqe*)sqes;
+
+        char* sq = (char*)sq_ptr_;
+        char* cq = (char*)cq_ptr_;
+        sq_head_ = (unsigned*)(sq + p.sq_off.head);
+        sq_tail_ = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask_ = *(unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array_ = (unsigned*)(sq + p.sq_off.array);
+        sq_entries_ = p.sq_entries;
+        cq_head_ = (unsigned*)(cq + p.cq_off.head);
+        cq_tail_ = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask_ = *(unsigned*)(cq + p.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        local_tail_ = *sq_tail_;
+
+        // Ū fixed file tableGopen  fd i slotA᭱ write/close H slot s_ӡA@eX
+        vector<int> fds(fixed_files, -1);
+        if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_FILES, fds.data(), fixed_files) != 0) return false;
+        return probe_direct_open();
+    }
+
+    unsigned capacity() const { return sq_entries_; }
+    // ٯƤJX SQE]kernel ٨SeΡ^F@ linked SQE n@_oU~}l
+    unsigned free_slots() const { return capacity() - (local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)); }
+
+    // SQ F^ nullptrA|¶^h\٨SeX SQE
+    io_uring_sqe* get_sqe() {
+        if (free_slots() == 0) return nullptr;
+        io_uring_sqe* sqe = &sqes_[local_tail_ & sq_mask_];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array_[local_tail_ & sq_mask_] = local_tail_ & sq_mask_;
+        ++local_tail_;
+        ++pending_;
+        return sqe;
+    }
+
+    // @eXثeҦ SQEAõo SQE  completion ^ӡFC completion Is on_cqe
+    template <typename F>
+    bool submit_and_reap(F on_cqe) {
+        unsigned want = pending_;
+        __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+        unsigned to_submit = pending_;
+        pending_ = 0;
+        while (want > 0) {
+            int rc = (int)syscall(__NR_io_uring_enter, fd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (rc < 0 && errno != EINTR) return false;
+            if (rc > 0) to_submit -= min<unsigned>(to_submit, rc);
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            for (; head != tail && want > 0; ++head, --want) {
+                const io_uring_cqe& c = cqes_[head & cq_mask_];
+                on_cqe(c.user_data, c.res);
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+
+private:
+    // OPENAT i fixed slot]direct descriptor^n 5.15 H᪺֤ߡG®֤ߤ{o file_indexAӼ˦^Ǥ@ fdA
+    // H slot eX WRITEV ѡBb᭱ CLOSE QACɮ׺|@ fd
+    // ҥH /dev/null ն}@] CLOSEG®֤߷| fd = 0 n fd^A^ 0 ~䴩
+    bool probe_direct_open() {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)"/dev/null";
+        sqe->open_flags = O_RDONLY;
+        sqe->file_index = 1; //slot 0
+        int res = -1;
+        if (!submit_and_reap([&](uint64_t, int r) { res = r; })) return false;
+        if (res > 0) ::close(res); //®֤ߡG쪺O@ fd
+        if (res != 0) return false;
+        sqe = get_sqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = 1;
+        int closed = -1;
+        return submit_and_reap([&](uint64_t, int r) { closed = r; }) && closed == 0;
+    }
+
+    int fd_{-1};
+    void* sq_ptr_{nullptr};
+    void* cq_ptr_{nullptr};
+    size_t sq_size_{0}, cq_size_{0}, sqes_size_{0};
+    io_uring_sqe* sqes_{nullptr};
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned* sq_array_{nullptr};
+    unsigned sq_mask_{0}, sq_entries_{0};
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    io_uring_cqe* cqes_{nullptr};
+    unsigned local_tail_{0};
+    unsigned pending_{0};
+};
+
+// Cɮװe@ linked SQEGOPENAT]i fixed slot^ WRITEV]Y + UC^ CLOSEAuݭn@ io_uring_enter
+// direct_min > 0 ɡApoӤjpɮק O_DIRECTGeƶi 4 KB ȦsϡAg block A truncate ^u
+// @Bѡ]ҦpɮרtΤ䴩 O_DIRECT^N飼@몺 write_pgm goɮ
+// ^ Posix  io_uring ΡB@ɮ׳٨Sg]ѩIsݳv write_pgm^
+static BatchPath write_pgm_batch_uring(vector<PgmJob>& jobs, vector<string>& failed, size_t direct_min) {
+    constexpr unsigned kSlots = 64;      // @̦hPɶ}۪ɮ׼
+    constexpr unsigned kRing = 1024;
+    constexpr int kMaxIov = 1024;        // IOV_MAX
+    constexpr size_t kBlock = 4096;
+    thread_local unique_ptr<IoUring> ring;
+    thread_local bool unavailable = false;
+    if (unavailable) return BatchPath::Posix;
+    if (!ring) {
+        ring.reset(new IoUring());
+        if (!ring->init(kRing, kSlots)) { //t֤ߤ䴩 direct descriptor
+            ring.reset();
+            unavailable = true;
+            return BatchPath::Posix;
+        }
+    }
+
+    struct State {
+        char header[kPgmHeaderMax];
+        size_t header_len{0};
+        vector<iovec> iov;
+        size_t exact{0};   // ɮׯu
+        size_t expect{0};  // ڰeX줸ռơ]O_DIRECT |ɨ block^
+        size_t written{0};
+        bool open_ok{false};
+        bool ok{true};
+        bool direct{false};
+        unique_ptr<uint8_t, void (*)(uint8_t*)> staging{nullptr, [](uint8_t* p) { ::operator delete(p, std::align_val_t(kBlock)); }};
+    };
+    vector<State> st(jobs.size());
+
+    // eX [first, last) o@BAѩΨSg㪺ɮק飼 write_pgmFring aF^ false
+    auto flush = [&](size_t first, size_t last) {
+        bool legacy_fd = false;
+        bool ok = ring->submit_and_reap([&](uint64_t ud, int res) {
+            State& s = st[ud >> 2];
+            switch (ud & 3) {
+            case 0:
+                if (res > 0) { //file_index QB@ fd]init Ӥwgױ^GAA ring
+                    ::close(res);
+                    legacy_fd = true;
+                }
+                s.open_ok = res == 0;
+                if (res != 0) s.ok = false;
+                break;
+            case 1: if (res < 0) s.ok = false; else s.written += (size_t)res; break;
+            case 2: if (res < 0) s.ok = false; break;
+            }
+        });
+        ok = ok && !legacy_fd;
+        if (!ok) { //ring aFGo thread @|
+            ring.reset();
+            unavailable = true;
+        }
+        for (size_t j = first; j < (ok ? last : jobs.size()); ++j) {
+            State& s = st[j];
+            if (!ok) s.ok = false;
+            if (s.ok && s.written == s.expect && s.direct) {
+                s.ok = truncate(jobs[j].path.c_str(), (off_t)s.exact) == 0;
+            }
+            if (!s.ok || s.written != s.expect) {
+                if (!write_pgm(jobs[j].path, jobs[j].img)) failed.push_back(jobs[j].path);
+            }
+            s = State();
+        }
+        return ok;
+    };
+
+    // @̦h kSlots ɮסABҦɮת OPENAT + WRITEVn + CLOSE [_ӭnoi SQF񤣤UNeXo@
+    size_t first = 0;
+    unsigned used = 0; //o@wƤJɮ׼ = U@ fixed slot
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        const ImageView img = jobs[j].img;
+        State& s = st[j];
+        s.header_len = pgm_header(s.header, img.w, img.h, 255);
+        size_t bytes = s.header_len + (size_t)img.w * img.h;
+        s.exact = s.expect = bytes;
+        s.direct = direct_min > 0 && bytes >= direct_min;
+        if (s.direct) { //O_DIRECT nD bufferBסB첾 block
+            size_t padded = (bytes + kBlock - 1) / kBlock * kBlock;
+            s.staging.reset((uint8_t*)::operator new(padded, std::align_val_t(kBlock)));
+            uint8_t* d = s.staging.get();
+            memcpy(d, s.header, s.header_len);
+            d += s.header_len;
+            for (int y = 0; y < img.h; ++y, d += img.w) memcpy(d, img.row(y).data(), img.w);
+            memset(d, 0, padded - bytes);
+            s.iov.push_back({s.staging.get(), padded});
+            s.expect = padded;
+        } else {
+            pgm_iovecs(s.iov, s.header, s.header_len, img);
+        }
+
+        unsigned need = 2 + (unsigned)((s.iov.size() + kMaxIov - 1) / kMaxIov);
+        if (need > ring->capacity()) { // SQ ٪]v^GƤJA flush 飼 write_pgm
+            s.ok = false;
+            continue;
+        }
+        if (used == kSlots || need > ring->free_slots()) {
+            if (!flush(first, j)) return BatchPath::IoUringPartial;
+            first = j;
+            used = 0;
+        }
+
+        unsigned slot = used++;
+        io_uring_sqe* sqe = ring->get_sqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)jobs[j].path.c_str();
+        sqe->len = 0644;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | (s.direct ? O_DIRECT : 0);
+        sqe->file_index = slot + 1;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = (uint64_t)j << 2 | 0;
+
+        size_t off = 0;
+        for (size_t k = 0; k < s.iov.size(); k += kMaxIov) {
+            int n = (int)min<size_t>(kMaxIov, s.iov.size() - k);
+            sqe = ring->get_sqe();
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = (int)slot;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+            sqe->addr = (uint64_t)(uintptr_t)&s.iov[k];
+            sqe->len = n;
+            sqe->off = off;
+            sqe->user_data = (uint64_t)j << 2 | 1;
+            for (int q = 0; q < n; ++q) off += s.iov[k + q].iov_len;
+        }
+
+        sqe = ring->get_sqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = slot + 1;
+        sqe->user_data = (uint64_t)j << 2 | 2;
+    }
+    if (first < jobs.size() && !flush(first, jobs.size())) return BatchPath::IoUringPartial;
+    return BatchPath::IoUring;
+}
+#endif
+
+BatchPath write_pgm_batch(vector<PgmJob>& jobs, vector<string>& failed, size_t direct_min) {
+#ifdef MMIP_IO_URING
+    BatchPath path = write_pgm_batch_uring(jobs, failed, direct_min);
+    if (path != BatchPath::Posix) return path;
+#else
+    (void)direct_min;
+#endif
+    for (auto& job : jobs) {
+        if (!write_pgm(job.path, job.img)) failed.push_back(job.path);
+    }
+    return BatchPath::Posix;
+}
+
+// DPBgɡGbounded C]h producer B@h writer thread ^ApMϺ I/O |
+// C submit() |]backpressure^AOζqWFu@̦sO GrayImageACOW @ bufferAge|Q
+// ӧOɮ׼gѤ_y{Afinish() ɤ@J^
+// writer thread CC̲{u@A浹 write_pgm_batch]Linux W io_uringA@unX syscall^
+class AsyncWriter {
+public:
+    explicit AsyncWriter(size_t capacity = 16, int threads = 2, size_t direct_min = 0)
+        : capacity_(capacity), direct_min_(direct_min) {
+        for (int i = 0; i < max(1, threads); ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+    ~AsyncWriter() { finish(); }
+
+    void submit(string path, GrayImage img) {
+        // arena W buffer Lo@Ah heap]Isݭngv̦n@}lNn arena^
+        if (img.pix.in_arena()) img.pix = PixelBuffer<uint8_t>(img.pix);
+        unique_lock<mutex> lk(mu_);
+        not_full_.wait(lk, [this] { return closed_ || queue_.size() < capacity_; });
+        if (closed_) { //finish()  writer thread wgAiCSHGbIsݼgAѤ@˰OU]AIs finish() io^
+            lk.unlock();
+            if (!write_pgm(path, img)) {
+                lock_guard<mutex> g(mu_);
+                failed_.push_back(std::move(path));
+            }
+            return;
+        }
+        queue_.push_back({std::move(path), std::move(img)});
+        not_empty_.notify_one();
+    }
+
+    // CMšB writer threadF^ǼgѪɮ׼ơ]iƩIs^
+    size_t finish() {
+        {
+            lock_guard<mutex> lk(mu_);
+            if (closed_) return failed_.size();
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+        for (auto& t : workers_) t.join();
+        workers_.clear();
+        if (!failed_.empty()) {
+            cerr << failed_.size() << " output file(s) could not be written:\n";
+            for (auto& p : failed_) cerr << "  " << p << "\n";
+        }
+        return failed_.size();
+    }
+
+private:
+    void run() {
+        vector<PgmJob> batch;
+        vector<string> failed;
+        for (;;) {
+            {
+                unique_lock<mutex> lk(mu_);
+                not_empty_.wait(lk, [this] { return closed_ || !queue_.empty(); });
+                if (queue_.empty()) return; //wBM
+                while (!queue_.empty()) {
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+                not_full_.notify_all();
+            }
+            write_pgm_batch(batch, failed, direct_min_);
+            batch.clear();
+            if (!failed.empty()) {
+                lock_guard<mutex> lk(mu_);
+                failed_.insert(failed_.end(), failed.begin(), failed.end());
+                failed.clear();
+            }
+        }
+    }
+
+    size_t capacity_;
+    size_t direct_min_;
+    deque<PgmJob> queue_;
+    mutex mu_;
+    condition_variable not_full_, not_empty_;
+    bool closed_{false};
+    vector<string> failed_;
+    vector<thread> workers_;
+};
+
 // إߤ@ SDL3 TextureAN GrayImage (8-bit Ƕ) X 24-bit RGB Aih
-static SDL_Texture* make_texture(SDL_Renderer* R, const GrayImage& g) {
+static SDL_Texture* make_texture(SDL_Renderer* R, const ImageView& g) {
     //  RGB888]C 4 bytesAwBۮe^
     SDL_Texture* tex = SDL_CreateTexture(R, SDL_PIXELFORMAT_XRGB8888,
                                      SDL_TEXTUREACCESS_STREAMING,
@@ -218,8 +1949,9 @@ static SDL_Texture* make_texture(SDL_Renderer* R, const GrayImage& g) {
         uint32_t* row = reinterpret_cast<uint32_t*>(
             reinterpret_cast<uint8_t*>(pixels) + y * pitch
         );
+        const uint8_t* MMIP_RESTRICT s = g.row(y).data();
         for (int x = 0; x < g.w; ++x) {
-            uint8_t v = g.at(x, y);
+            uint8_t v = s[x];
             uint32_t rgb = (uint32_t(v) << 16) | (uint32_t(v) << 8) | uint32_t(v);
             row[x] = rgb;
         }
@@ -232,7 +1964,98 @@ static SDL_Texture* make_texture(SDL_Renderer* R, const GrayImage& g) {
     return tex;
 }
 
-int main() {
+// gɮįGn  64x64 PGMAv write_pgmAA write_pgm_batchALX̮ɶMȦs
+static int run_io_bench(int n, size_t direct_min) {
+    string dir = "results/bench_io";
+    ensure_dir("results");
+    ensure_dir(dir);
+    GrayImage img;
+    img.allocate(64, 64);
+    for (int y = 0; y < img.h; ++y)
+        for (int x = 0; x < img.w; ++x) img.at(x, y) = (uint8_t)(x * 4 + y);
+
+    auto seconds_since = [](chrono::steady_clock::time_point t0) {
+        return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    };
+    // ؼgkUgiۤvťؿAOusɮסv
+    auto make_jobs = [&](const string& sub) {
+        ensure_dir(dir + "/" + sub);
+        vector<PgmJob> jobs;
+        jobs.reserve(n);
+        for (int i = 0; i < n; ++i) jobs.push_back({dir + "/" + sub + "/" + to_string(i) + ".pgm", img});
+        return jobs;
+    };
+
+    vector<PgmJob> jobs = make_jobs("seq");
+    auto t0 = chrono::steady_clock::now();
+    size_t seq_failed = 0;
+    for (auto& job : jobs) seq_failed += !write_pgm(job.path, job.img);
+    double t_seq = seconds_since(t0);
+
+    jobs = make_jobs("batch");
+    vector<string> failed;
+    t0 = chrono::steady_clock::now();
+    BatchPath path = write_pgm_batch(jobs, failed, direct_min);
+    double t_batch = seconds_since(t0);
+
+    cout << fixed << setprecision(3)
+         << "[BENCH] " << n << " files  write_pgm " << t_seq * 1000 << " ms"
+         << "  write_pgm_batch " << t_batch * 1000 << " ms (" << batch_path_name(path) << ")\n"; //ɹڨ|AOsĶﶵ
+    fs::remove_all(dir);
+    return (seq_failed || !failed.empty()) ? 4 : 0;
+}
+
+int main(int argc, char** argv) {
+    // ROCG--raw-size WxHB--raw-offset NAMΦbS sidecar (.info)  RAW W
+    // --direct-io-min BYTESGpoӤjpXɥ O_DIRECT g]0 = Ρ^F--bench-io NGu]gɮį
+    // --jpeg-scale NGJPEG Ѧ 1/N jp]N = 1B2B4B8^A᪺BzHoӤؤoӷAAj^ 512x512
+    // --max-size WxHB--max-channels NB--expect-size WxHGѽXeYˬdJAXڵ] InputLimits^
+    RawSpec raw_default;
+    InputLimits limits;
+    size_t direct_min = 0;
+    int bench_io = 0;
+    int jpeg_scale = 1;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--raw-size" && a + 1 < argc && sscanf(argv[a + 1], "%dx%d", &raw_default.w, &raw_default.h) == 2) {
+            ++a;
+        } else if (arg == "--raw-offset" && a + 1 < argc) {
+            raw_default.offset = strtoull(argv[++a], nullptr, 10);
+        } else if (arg == "--direct-io-min" && a + 1 < argc) {
+            direct_min = strtoull(argv[++a], nullptr, 10);
+        } else if (arg == "--bench-io" && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+            bench_io = atoi(argv[++a]);
+        } else if (arg == "--jpeg-scale" && a + 1 < argc) {
+            jpeg_scale = atoi(argv[++a]);
+            if (jpeg_scale != 1 && jpeg_scale != 2 && jpeg_scale != 4 && jpeg_scale != 8) {
+                cerr << "--jpeg-scale must be 1, 2, 4 or 8\n";
+                return 1;
+            }
+        } else if (arg == "--max-size" && a + 1 < argc && sscanf(argv[a + 1], "%dx%d", &limits.max_w, &limits.max_h) == 2) {
+            ++a;
+        } else if (arg == "--expect-size" && a + 1 < argc && sscanf(argv[a + 1], "%dx%d", &limits.expect_w, &limits.expect_h) == 2) {
+            ++a;
+        } else if (arg == "--max-channels" && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+            limits.max_comp = atoi(argv[++a]);
+        } else {
+            cerr << "usage: " << argv[0] << " [--raw-size WxH] [--raw-offset BYTES] [--direct-io-min BYTES] [--bench-io N] [--jpeg-scale 1|2|4|8]"
+                 << " [--max-size WxH] [--max-channels N] [--expect-size WxH]\n";
+            return 1;
+        }
+    }
+    size_t raw_bytes;
+    if (!raw_spec_bytes(raw_default, 1, raw_bytes)) {
+        cerr << "invalid --raw-size / --raw-offset\n";
+        return 1;
+    }
+    if (limits.max_w <= 0 || limits.max_h <= 0 || (limits.expect_w > 0) != (limits.expect_h > 0)) {
+        cerr << "invalid --max-size / --expect-size\n";
+        return 1;
+    }
+    if (bench_io > 0) return run_io_bench(bench_io, direct_min);
+    ParallelForPool jpeg_pool(max(1, (int)thread::hardware_concurrency()) - 1); //ŧib DecodeStage eG̫~
+    stbi_jpeg_set_parallel_for(ParallelForPool::hook, &jpeg_pool, jpeg_pool.width()); //u@֤߮ width = 1Astb ǦCѽX
+
     ensure_dir("results");
 
     vector<fs::path> raw_paths, img_paths;
@@ -261,87 +2084,126 @@ int main() {
     sort(raw_paths.begin(), raw_paths.end(), by_name);
     sort(img_paths.begin(), img_paths.end(), by_name);
 
-    vector<GrayImage> imgs;
+    vector<GrayImage> imgs(raw_paths.size() + img_paths.size());
     vector<string> tags; // ΨӰOXɦWAtɦW
-    imgs.reserve(6);
 
-    // Ū RAW
+    // Ū RAWBBMP/JPGGᵹ DecodeStage ѽXAsNOƧǫ᪺m
+    vector<DecodeJob> jobs;
     for (auto& p : raw_paths) {
-        GrayImage g;
-        if (!read_raw(p.string(), g)) return 2;
-        imgs.push_back(g);
+        jobs.push_back({jobs.size(), p.string(), true, raw_spec_for(p.string(), raw_default), 1});
         tags.push_back(p.stem().string()); 
     }
-
-    // Ū BMP/JPG
     for (auto& p : img_paths) {
-        GrayImage g;
-        if (!read_gray_any(p.string(), g)) return 3;
-        imgs.push_back(g);
+        jobs.push_back({jobs.size(), p.string(), false, RawSpec(), jpeg_scale});
         tags.push_back(p.stem().string()); 
     }
 
+    // ѽXeҦJGXW檺bo̴NCXõ]^ǭȦPѽXѡGRAW 2BL 3^AqL̤jpƦnѽX
+    vector<ProbeInfo> probes;
+    vector<size_t> rejected;
+    if (!plan_decode(jobs, limits, probes, rejected)) {
+        return rejected[0] < raw_paths.size() ? 2 : 3;
+    }
+    for (size_t i = 0; i < probes.size(); ++i) {
+        if (probes[i].scale > 1) {
+            cerr << tags[i] << ": decoded at 1/" << probes[i].scale << " (" << probes[i].w << "x" << probes[i].h << "), processed at that size\n";
+        } else if (probes[i].w != 512 || probes[i].h != 512) {
+            cerr << tags[i] << ": " << probes[i].w << "x" << probes[i].h << ", resampled to 512x512\n";
+        }
+    }
+
     // X
     double g = 2.2; //gamma
-    for (int i = 0; i < 6; ++i) {
-        string tag = tags[i];
-        print_center10(imgs[i], tag);
-        write_pgm("results/" + tag + ".pgm", imgs[i]);
-
-        auto neg = negative(imgs[i]);
-        write_pgm("results/" + tag + "_neg.pgm", neg);
-
-        // Log
-        auto logimg = log_transform(imgs[i]);
-        write_pgm("results/" + tag + "_log.pgm", logimg);
-
-        // Gamma
-        auto gim = gamma_transform(imgs[i], g);
-        write_pgm("results/" + tag + "_gamma" + ".pgm", gim);
-    }
-    // c) Down/Up sampling comparisons
-    for (int i = 0; i < (int)imgs.size(); ++i) {
-        const string& tag = tags[i];
-        const GrayImage& g = imgs[i];
-
-        // ڭ̥HuYevO 512512Auʭ˨ 512512vTOW@P]רO BMP/JPG O 512^
-        GrayImage base = (g.w == 512 && g.h == 512) ? g : resize_bilinear(g, 512, 512);
-
-        // (i) 512->128
-        auto n_512_128 = resize_nearest(base, 128, 128);
-        auto b_512_128 = resize_bilinear(base, 128, 128);
-        write_pgm("results/" + tag + "_n_512to128.pgm", n_512_128);
-        write_pgm("results/" + tag + "_b_512to128.pgm", b_512_128);
-
-        // (ii) 512->32
-        auto n_512_32 = resize_nearest(base, 32, 32);
-        auto b_512_32 = resize_bilinear(base, 32, 32);
-        write_pgm("results/" + tag + "_n_512to32.pgm", n_512_32);
-        write_pgm("results/" + tag + "_b_512to32.pgm", b_512_32);
-
-        // (iii) 32->512 ]UAAW^
-        auto n_32 = resize_nearest(base, 32, 32);
-        auto b_32 = resize_bilinear(base, 32, 32);
-        auto n_32_512 = resize_nearest(n_32, 512, 512);
-        auto b_32_512 = resize_bilinear(b_32, 512, 512);
-        write_pgm("results/" + tag + "_n_32to512.pgm", n_32_512);
-        write_pgm("results/" + tag + "_b_32to512.pgm", b_32_512);
-
-        // (iv) 512->1024x512]j 2x^
-        auto n_1024_512 = resize_nearest(base, 1024, 512);
-        auto b_1024_512 = resize_bilinear(base, 1024, 512);
-        write_pgm("results/" + tag + "_n_512to1024x512.pgm", n_1024_512);
-        write_pgm("results/" + tag + "_b_512to1024x512.pgm", b_1024_512);
-
-        // (v) 128x128->256x512]U 128x128AADW 256x512^
-        auto n_128 = resize_nearest(base, 128, 128);
-        auto b_128 = resize_bilinear(base, 128, 128);
-        auto n_128_256x512 = resize_nearest(n_128, 256, 512);
-        auto b_128_256x512 = resize_bilinear(b_128, 256, 512);
-        write_pgm("results/" + tag + "_n_128to256x512.pgm", n_128_256x512);
-        write_pgm("results/" + tag + "_b_128to256x512.pgm", b_128_256x512);
-    }
+    Arena arena; // C@iubp⤤Ψ쪺v]n_32Bb_128K^tmbo̡AU@i}lɾk
+    AsyncWriter writer(16, 2, direct_min); // nXv浹 writer threadA|Lo@AҥH arena
+
+    // @ivBzGb) IBBc) Down/Up samplingF 10x10 gi outAѩIsݨ̽sǦLX
+    auto process = [&](int i, ostream& out) {
+        arena.reset(); // W@ivw} scope
+        {
+            string tag = tags[i];
+            print_center10(imgs[i], tag, out);
+            writer.submit("results/" + tag + ".pgm", imgs[i]);
 
+            auto neg = negative(imgs[i]);
+            writer.submit("results/" + tag + "_neg.pgm", neg);
+
+            // Log
+            auto logimg = log_transform(imgs[i]);
+            writer.submit("results/" + tag + "_log.pgm", logimg);
+
+            // Gamma
+            auto gim = gamma_transform(imgs[i], g);
+            writer.submit("results/" + tag + "_gamma" + ".pgm", gim);
+        }
+        // c) Down/Up sampling comparisons
+        {
+            const string& tag = tags[i];
+            const GrayImage& g = imgs[i];
+
+            // ڭ̥HuYevO 512512Auʭ˨ 512512vTOW@P]רO BMP/JPG O 512^
+            // wgO 512512 NέϪϡAt~ƻs@
+            // --jpeg-scale YpѽX JPEG ҥ~GHѽXؤoӷ]512to128 Xؤoܡ^A
+            // j^ 512 AYu|o@iҽkؤoϡA]նOFYpѽX٤Uu
+            GrayImage resized;
+            ImageView base = g;
+            if (probes[i].scale == 1 && (g.w != 512 || g.h != 512)) {
+                resized = resize_bilinear(g, 512, 512, &arena);
+                base = resized;
+            }
+
+            // (i) 512->128
+            auto n_512_128 = resize_nearest(base, 128, 128);
+            auto b_512_128 = resize_bilinear(base, 128, 128);
+            writer.submit("results/" + tag + "_n_512to128.pgm", n_512_128);
+            writer.submit("results/" + tag + "_b_512to128.pgm", b_512_128);
+
+            // (ii) 512->32
+            auto n_512_32 = resize_nearest(base, 32, 32);
+            auto b_512_32 = resize_bilinear(base, 32, 32);
+            writer.submit("results/" + tag + "_n_512to32.pgm", n_512_32);
+            writer.submit("results/" + tag + "_b_512to32.pgm", b_512_32);
+
+            // (iii) 32->512 ]UAAW^
+            auto n_32 = resize_nearest(base, 32, 32, &arena);
+            auto b_32 = resize_bilinear(base, 32, 32, &arena);
+            auto n_32_512 = resize_nearest(n_32, 512, 512);
+            auto b_32_512 = resize_bilinear(b_32, 512, 512);
+            writer.submit("results/" + tag + "_n_32to512.pgm", n_32_512);
+            writer.submit("results/" + tag + "_b_32to512.pgm", b_32_512);
+
+            // (iv) 512->1024x512]j 2x^
+            auto n_1024_512 = resize_nearest(base, 1024, 512);
+            auto b_1024_512 = resize_bilinear(base, 1024, 512);
+            writer.submit("results/" + tag + "_n_512to1024x512.pgm", n_1024_512);
+            writer.submit("results/" + tag + "_b_512to1024x512.pgm", b_1024_512);
+
+            // (v) 128x128->256x512]U 128x128AADW 256x512^
+            auto n_128 = resize_nearest(base, 128, 128, &arena);
+            auto b_128 = resize_bilinear(base, 128, 128, &arena);
+            auto n_128_256x512 = resize_nearest(n_128, 256, 512);
+            auto b_128_256x512 = resize_bilinear(b_128, 256, 512);
+            writer.submit("results/" + tag + "_n_128to256x512.pgm", n_128_256x512);
+            writer.submit("results/" + tag + "_b_128to256x512.pgm", b_128_256x512);
+        }
+    };
+
+    // iѧNBzFLùeɦWǿXAGMviBzɤ@
+    DecodeStage decoder(std::move(jobs)); // ŧib writer G return ɥѽXAAg
+    vector<string> logs(imgs.size());
+    vector<char> processed(imgs.size(), 0);
+    size_t next_log = 0;
+    Decoded d;
+    while (decoder.next(d)) {
+        if (!d.ok) return d.index < raw_paths.size() ? 2 : 3;
+        imgs[d.index] = std::move(d.img);
+        ostringstream out;
+        process((int)d.index, out);
+        logs[d.index] = out.str();
+        processed[d.index] = 1;
+        while (next_log < imgs.size() && processed[next_log]) cout << logs[next_log++];
+    }
+    writer.finish(); // ҦXgFѪɮצbo̤@CX
 
     cout << "[DONE] Saved outputs in ./results (filenames match originals)\n";
     
@@ -274,6 +274,13 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// On x86 with GCC/Clang or VC++ 2012+, the JPEG IDCT additionally has an
+// AVX2 path (two blocks per call) that is chosen by a run-time CPU test and
+// is bit-identical to the C version; define STBI_NO_AVX2 to leave it out.
+// Likewise the RGB->Y conversions used for req_comp 1 and 2 have an SSSE3
+// path, also picked at run time and bit-exact; define STBI_NO_SSSE3 to
+// leave it out.
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -524,6 +531,29 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// decode JPEGs at 1/2, 1/4 or 1/8 size (scale_denom = 2, 4, 8; 1 = full size)
+// using a reduced IDCT that only produces 4x4, 2x2 or 1x1 pixels per 8x8 block;
+// the returned width/height are the scaled ones (rounded up). other formats and
+// stbi_info are not affected. the _thread variant has the same caveats as above
+//
+// chroma quality: components subsampled equally in both directions (4:2:0 etc.)
+// get a correspondingly larger IDCT and come out at output resolution. with
+// h != v subsampling (4:2:2, 4:4:0) they keep the luma's reduced IDCT and are
+// upsampled afterwards, so at 1/4 and 1/8 chroma is rebuilt from about the DC
+// term alone: mean error vs. a box-averaged full decode is about 4-8 levels
+// there, against at most about 2 elsewhere. greyscale output (req_comp 1 or 2)
+// of YCbCr files only decodes luma and is unaffected
+STBIDEF void stbi_jpeg_set_scale_denom(int scale_denom);
+STBIDEF void stbi_jpeg_set_scale_denom_thread(int scale_denom);
+
+// decode the restart intervals of baseline JPEGs in parallel. fn must call
+// task(arg, i) for every i in [0,count), from any threads, and return when all
+// are done; count is at most 'threads', each task decodes a run of intervals.
+// only used when the file is in memory (stbi_load_from_memory etc.) and carries
+// restart markers; pass NULL or threads <= 1 to go back to serial decoding
+typedef void stbi_jpeg_parallel_for(void *user, int count, void (*task)(void *arg, int index), void *arg);
+STBIDEF void stbi_jpeg_set_parallel_for(stbi_jpeg_parallel_for *fn, void *user, int threads);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -750,7 +780,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -761,7 +791,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -771,9 +801,59 @@ static int stbi__sse2_available(void)
 }
 #endif
 
+#endif
+
+// AVX2: only the JPEG IDCT uses it, compiled per function and picked at run time
+#if !defined(STBI_NO_JPEG) && !defined(STBI_NO_AVX2) && (defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1700))
+#define STBI_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,0);
+   if (info[0] < 7) return 0;
+   __cpuid(info,1);
+   if ((info[2] & (1<<27)) == 0 || (info[2] & (1<<28)) == 0) return 0; // OSXSAVE, AVX
+   if ((_xgetbv(0) & 6) != 6) return 0; // OS saves the ymm state
+   __cpuidex(info,7,0);
+   return (info[1] >> 5) & 1;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   // also checks that the OS has enabled the ymm state
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
+// SSSE3: only the RGB->Y conversions in stbi__convert_format(16) use it
+#if !defined(STBI_NO_SSSE3) && (defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1500)) && \
+    !(defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM))
+#define STBI_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#define STBI__SSSE3_TARGET
+static int stbi__ssse3_available(void)
+{
+   int info[4];
+   __cpuid(info,1);
+   return (info[2] >> 9) & 1;
+}
+#else
+#define STBI__SSSE3_TARGET __attribute__((target("ssse3")))
+static int stbi__ssse3_available(void)
+{
+   return __builtin_cpu_supports("ssse3");
+}
 #endif
 #endif
 
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -1134,6 +1214,29 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__jpeg_scale_denom_global = 1;
+
+STBIDEF void stbi_jpeg_set_scale_denom(int scale_denom)
+{
+   stbi__jpeg_scale_denom_global = scale_denom;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_scale_denom  stbi__jpeg_scale_denom_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_scale_denom_local, stbi__jpeg_scale_denom_set;
+
+STBIDEF void stbi_jpeg_set_scale_denom_thread(int scale_denom)
+{
+   stbi__jpeg_scale_denom_local = scale_denom;
+   stbi__jpeg_scale_denom_set = 1;
+}
+
+#define stbi__jpeg_scale_denom  (stbi__jpeg_scale_denom_set       \
+                                 ? stbi__jpeg_scale_denom_local  \
+                                 : stbi__jpeg_scale_denom_global)
+#endif // STBI_THREAD_LOCAL
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1747,6 +1850,41 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 {
    return (stbi_uc) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
+
+#ifdef STBI_SSSE3
+// stbi__compute_y on the first pixels of a row of 3 or 4 components, 8 at a
+// time; returns how many were done, the caller finishes the rest. 150 does not
+// fit a signed byte weight, so pmaddubsw forms r*77+b*29 and g*75, and pmaddwd
+// adds them as (r*77+b*29)*1 + (g*75)*2; neither step can saturate.
+static STBI__SSSE3_TARGET int stbi__compute_y_row_ssse3(stbi_uc *dest, stbi_uc const *src, int img_n, int req_comp, int x)
+{
+   __m128i shuf = img_n == 3 ? _mm_setr_epi8(0,2,1,-1, 3,5,4,-1, 6,8,7,-1, 9,11,10,-1)
+                             : _mm_setr_epi8(0,2,1,-1, 4,6,5,-1, 8,10,9,-1, 12,14,13,-1);
+   __m128i wb = _mm_setr_epi8(77,29,75,0, 77,29,75,0, 77,29,75,0, 77,29,75,0);
+   __m128i ww = _mm_setr_epi16(1,2, 1,2, 1,2, 1,2);
+   // with 3 components the second 16-byte load reaches 4 bytes past the 8 pixels
+   int last = img_n == 3 ? x - 10 : x - 8;
+   int i;
+   for (i=0; i <= last; i += 8) {
+      __m128i p0 = _mm_loadu_si128((__m128i const *) (src + i*img_n));
+      __m128i p1 = _mm_loadu_si128((__m128i const *) (src + (i+4)*img_n));
+      __m128i y0 = _mm_srli_epi32(_mm_madd_epi16(_mm_maddubs_epi16(_mm_shuffle_epi8(p0, shuf), wb), ww), 8);
+      __m128i y1 = _mm_srli_epi32(_mm_madd_epi16(_mm_maddubs_epi16(_mm_shuffle_epi8(p1, shuf), wb), ww), 8);
+      __m128i y  = _mm_packs_epi32(y0, y1);
+      if (req_comp == 1) {
+         _mm_storel_epi64((__m128i *) (dest + i), _mm_packus_epi16(y, y));
+      } else {
+         __m128i a;
+         if (img_n == 3)
+            a = _mm_set1_epi16((short) 0xff00);
+         else
+            a = _mm_slli_epi16(_mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24)), 8);
+         _mm_storeu_si128((__m128i *) (dest + 2*i), _mm_or_si128(y, a));
+      }
+   }
+   return i;
+}
+#endif
 #endif
 
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
@@ -1754,7 +1892,7 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 #else
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   int i,j,k=0,simd=0;
    unsigned char *good;
 
    if (req_comp == img_n) return data;
@@ -1766,12 +1904,24 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
       return stbi__errpuc("outofmem", "Out of memory");
    }
 
+   #ifdef STBI_SSSE3
+   simd = img_n >= 3 && req_comp <= 2 && stbi__ssse3_available();
+   #endif
+
    for (j=0; j < (int) y; ++j) {
       unsigned char *src  = data + j * x * img_n   ;
       unsigned char *dest = good + j * x * req_comp;
 
+      #ifdef STBI_SSSE3
+      if (simd) {
+         k = stbi__compute_y_row_ssse3(dest, src, img_n, req_comp, (int) x);
+         src  += k * img_n;
+         dest += k * req_comp;
+      }
+      #endif
+
       #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=(int) x-1-k; i >= 0; --i, src += a, dest += b)
       // convert source image with img_n components to one with req_comp components;
       // avoid switch per pixel, so use switch per scanline and massive macros
       switch (STBI__COMBO(img_n, req_comp)) {
@@ -1804,6 +1954,47 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 {
    return (stbi__uint16) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
+
+#ifdef STBI_SSSE3
+// 16-bit version of stbi__compute_y_row_ssse3. pmaddwd multiplies signed words,
+// so samples are biased by -32768 first; unused lanes get weight 0.
+static STBI__SSSE3_TARGET int stbi__compute_y_row16_ssse3(stbi__uint16 *dest, stbi__uint16 const *src, int img_n, int req_comp, int x)
+{
+   __m128i shuf = img_n == 3 ? _mm_setr_epi8(0,1,2,3,4,5,-1,-1, 6,7,8,9,10,11,-1,-1)
+                             : _mm_setr_epi8(0,1,2,3,4,5,-1,-1, 8,9,10,11,12,13,-1,-1);
+   __m128i ashuf = _mm_setr_epi8(6,7,14,15, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1);
+   __m128i w = _mm_setr_epi16(77,150,29,0, 77,150,29,0);
+   __m128i bias = _mm_set1_epi16((short) 0x8000);
+   // with 3 components the last 16-byte load reaches 4 bytes past the 8 pixels
+   int last = img_n == 3 ? x - 10 : x - 8;
+   int i,n;
+   for (i=0; i <= last; i += 8) {
+      __m128i p[4], m[4], y0, y1, y;
+      for (n=0; n < 4; ++n) {
+         p[n] = _mm_loadu_si128((__m128i const *) (src + (i+2*n)*img_n));
+         m[n] = _mm_madd_epi16(_mm_xor_si128(_mm_shuffle_epi8(p[n], shuf), bias), w);
+      }
+      // the biased sums are (r*77+g*150+b*29) - 32768*256, so shifting them
+      // gives y-32768, which packs_epi32 keeps exactly; the xor unbiases it
+      y0 = _mm_srai_epi32(_mm_hadd_epi32(m[0], m[1]), 8);
+      y1 = _mm_srai_epi32(_mm_hadd_epi32(m[2], m[3]), 8);
+      y  = _mm_xor_si128(_mm_packs_epi32(y0, y1), bias);
+      if (req_comp == 1) {
+         _mm_storeu_si128((__m128i *) (dest + i), y);
+      } else {
+         __m128i a;
+         if (img_n == 3)
+            a = _mm_set1_epi16(-1);
+         else
+            a = _mm_unpacklo_epi64(_mm_unpacklo_epi32(_mm_shuffle_epi8(p[0], ashuf), _mm_shuffle_epi8(p[1], ashuf)),
+                                   _mm_unpacklo_epi32(_mm_shuffle_epi8(p[2], ashuf), _mm_shuffle_epi8(p[3], ashuf)));
+         _mm_storeu_si128((__m128i *) (dest + 2*i    ), _mm_unpacklo_epi16(y, a));
+         _mm_storeu_si128((__m128i *) (dest + 2*i + 8), _mm_unpackhi_epi16(y, a));
+      }
+   }
+   return i;
+}
+#endif
 #endif
 
 #if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
@@ -1811,7 +2002,7 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 #else
 static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   int i,j,k=0,simd=0;
    stbi__uint16 *good;
 
    if (req_comp == img_n) return data;
@@ -1823,12 +2014,24 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
       return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
    }
 
+   #ifdef STBI_SSSE3
+   simd = img_n >= 3 && req_comp <= 2 && stbi__ssse3_available();
+   #endif
+
    for (j=0; j < (int) y; ++j) {
       stbi__uint16 *src  = data + j * x * img_n   ;
       stbi__uint16 *dest = good + j * x * req_comp;
 
+      #ifdef STBI_SSSE3
+      if (simd) {
+         k = stbi__compute_y_row16_ssse3(dest, src, img_n, req_comp, (int) x);
+         src  += k * img_n;
+         dest += k * req_comp;
+      }
+      #endif
+
       #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=(int) x-1-k; i >= 0; --i, src += a, dest += b)
       // convert source image with img_n components to one with req_comp components;
       // avoid switch per pixel, so use switch per scanline and massive macros
       switch (STBI__COMBO(img_n, req_comp)) {
@@ -1969,6 +2172,7 @@ typedef struct
       int dc_pred;
 
       int x,y,w2,h2;
+      int idct_size; // pixels per block side in data (see stbi__jpeg_idct)
       stbi_uc *data;
       void *raw_data, *raw_coeff;
       stbi_uc *linebuf;
@@ -1990,12 +2194,20 @@ typedef struct
    int            jfif;
    int            app14_color_transform; // Adobe APP14 tag
    int            rgb;
+   int            want_grey; // caller wants grey (+alpha) output
+   int            luma_only; // YCbCr with want_grey: only Y is reconstructed (decided at SOF)
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int idct_size; // 8, or 4/2/1 for a scaled decode: block size of the full-resolution components
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+   void (*idct_pair_kernel)(stbi_uc *outa, int stridea, const short *dataa, stbi_uc *outb, int strideb, const short *datab);
+   short    idct_pend_buf[64]; // baseline: copy of the queued block's coefficients
+   short   *idct_pend;        // 8x8 block queued for idct_pair_kernel, or NULL
+   stbi_uc *idct_pend_out;
+   int      idct_pend_stride;
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
@@ -2262,6 +2474,50 @@ static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman
    return 1;
 }
 
+// entropy-decode one block without reconstructing it: same bit consumption and DC
+// prediction as stbi__jpeg_decode_block, but nothing is stored or dequantized
+static int stbi__jpeg_skip_block(stbi__jpeg *j, stbi__huffman *hdc, stbi__huffman *hac, stbi__int16 *fac, int b)
+{
+   int diff,k;
+   int t;
+
+   if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
+   t = stbi__jpeg_huff_decode(j, hdc);
+   if (t < 0 || t > 15) return stbi__err("bad huffman code","Corrupt JPEG");
+
+   diff = t ? stbi__extend_receive(j, t) : 0;
+   if (!stbi__addints_valid(j->img_comp[b].dc_pred, diff)) return stbi__err("bad delta","Corrupt JPEG");
+   j->img_comp[b].dc_pred += diff;
+
+   k = 1;
+   do {
+      int c,r,s;
+      if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
+      c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+      r = fac[c];
+      if (r) { // fast-AC path: code and value bits in one go
+         k += ((r >> 4) & 15) + 1;
+         s = r & 15;
+         if (s > j->code_bits) return stbi__err("bad huffman code", "Combined length longer than code bits available");
+         j->code_buffer <<= s;
+         j->code_bits -= s;
+      } else {
+         int rs = stbi__jpeg_huff_decode(j, hac);
+         if (rs < 0) return stbi__err("bad huffman code","Corrupt JPEG");
+         s = rs & 15;
+         r = rs >> 4;
+         if (s == 0) {
+            if (rs != 0xf0) break; // end block
+            k += 16;
+         } else {
+            k += r + 1;
+            stbi__jpeg_get_bits(j, s);
+         }
+      }
+   } while (k < 64);
+   return 1;
+}
+
 static int stbi__jpeg_decode_block_prog_dc(stbi__jpeg *j, short data[64], stbi__huffman *hdc, int b)
 {
    int diff,dc;
@@ -2523,6 +2779,64 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced-size IDCTs for scaled decoding: only the N lowest frequencies in each
+// direction (N = 4, 2), each output pixel being the mean of an (8/N)x(8/N) area of
+// the full-size block. coefficients are 2048*c(u) * the mean of cos((2x+1)u*pi/16)
+// over the 8/N pixels x that output pixel p covers
+static const int stbi__idct_4_coef[4][4] = {
+   { 1448,  1856,  1338,   652 },
+   { 1448,   769, -1338, -1573 },
+   { 1448,  -769, -1338,  1573 },
+   { 1448, -1856,  1338,  -652 },
+};
+static const int stbi__idct_2_coef[2][2] = {
+   { 1448,  1312 },
+   { 1448, -1312 },
+};
+
+static void stbi__idct_reduced(stbi_uc *out, int out_stride, short data[64], int n, const int *coef)
+{
+   int u,v,p,q,tmp[4][4];
+   // columns: tmp[q][u] keeps 2 extra bits (1<<11 from coef, minus 9)
+   for (u=0; u < n; ++u) {
+      for (q=0; q < n; ++q) {
+         int t = 0;
+         for (v=0; v < n; ++v)
+            t += coef[q*n+v] * data[v*8+u];
+         t >>= 9;
+         // clamp so corrupt coefficients can't overflow the second pass; never hit by valid data
+         if (t > (1<<18)) t = 1<<18; else if (t < -(1<<18)) t = -(1<<18);
+         tmp[q][u] = t;
+      }
+   }
+   // rows: another 1<<11, the 2 extra bits and the 1/4 normalization, so >>15 total
+   for (q=0; q < n; ++q, out += out_stride) {
+      for (p=0; p < n; ++p) {
+         int t = 16384 + (128<<15);
+         for (u=0; u < n; ++u)
+            t += coef[p*n+u] * tmp[q][u];
+         out[p] = stbi__clamp(t >> 15);
+      }
+   }
+}
+
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   stbi__idct_reduced(out, out_stride, data, 4, &stbi__idct_4_coef[0][0]);
+}
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   stbi__idct_reduced(out, out_stride, data, 2, &stbi__idct_2_coef[0][0]);
+}
+
+// DC only: the block mean
+static void stbi__idct_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2704,6 +3018,185 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT of two blocks at once: block A in the low 128-bit lane, block B
+// in the high one. every step of stbi__idct_simd is lane-local, so this is the same
+// computation lane by lane and bit-identical to it (and to the generic C version).
+static STBI__AVX2_TARGET void stbi__idct_avx2_x2(stbi_uc *outa, int stridea, const short *dataa,
+                                                 stbi_uc *outb, int strideb, const short *datab)
+{
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
+
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   // one row of each block
+   #define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (dataa + (r)*8))), \
+                              _mm_loadu_si128((const __m128i *) (datab + (r)*8)), 1)
+
+   // two output rows of each block: p's low/high 8 bytes of each lane
+   #define dct_store2(p) \
+      { \
+         __m128i pa = _mm256_castsi256_si128(p), pb = _mm256_extracti128_si256(p, 1); \
+         _mm_storel_epi64((__m128i *) outa, pa); outa += stridea; \
+         _mm_storel_epi64((__m128i *) outa, _mm_shuffle_epi32(pa, 0x4e)); outa += stridea; \
+         _mm_storel_epi64((__m128i *) outb, pb); outb += strideb; \
+         _mm_storel_epi64((__m128i *) outb, _mm_shuffle_epi32(pb, 0x4e)); outb += strideb; \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   row0 = dct_load(0);
+   row1 = dct_load(1);
+   row2 = dct_load(2);
+   row3 = dct_load(3);
+   row4 = dct_load(4);
+   row5 = dct_load(5);
+   row6 = dct_load(6);
+   row7 = dct_load(7);
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose, per lane
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m256i p0 = _mm256_packus_epi16(row0, row1);
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose, per lane
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // store
+      dct_store2(p0);
+      dct_store2(p2);
+      dct_store2(p1);
+      dct_store2(p3);
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store2
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2946,67 +3439,220 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// IDCT one block of component n into its plane at the component's output block size.
+// with a pair kernel, full-size blocks are queued and transformed two at a time;
+// 'data' must then stay untouched until stbi__jpeg_idct_flush unless 'copy' is set
+static void stbi__jpeg_idct(stbi__jpeg *z, int n, stbi_uc *out, short data[64], int copy)
+{
+   switch (z->img_comp[n].idct_size) {
+      case 4:  stbi__idct_4x4(out, z->img_comp[n].w2, data); break;
+      case 2:  stbi__idct_2x2(out, z->img_comp[n].w2, data); break;
+      case 1:  stbi__idct_1x1(out, z->img_comp[n].w2, data); break;
+      default:
+         if (!z->idct_pair_kernel) {
+            z->idct_block_kernel(out, z->img_comp[n].w2, data);
+         } else if (z->idct_pend) {
+            z->idct_pair_kernel(z->idct_pend_out, z->idct_pend_stride, z->idct_pend, out, z->img_comp[n].w2, data);
+            z->idct_pend = NULL;
+         } else {
+            if (copy) {
+               memcpy(z->idct_pend_buf, data, sizeof(z->idct_pend_buf));
+               data = z->idct_pend_buf;
+            }
+            z->idct_pend = data;
+            z->idct_pend_out = out;
+            z->idct_pend_stride = z->img_comp[n].w2;
+         }
+         break;
+   }
+}
+
+// transform a block still queued by stbi__jpeg_idct
+static void stbi__jpeg_idct_flush(stbi__jpeg *z)
+{
+   if (z->idct_pend) {
+      z->idct_block_kernel(z->idct_pend_out, z->idct_pend_stride, z->idct_pend);
+      z->idct_pend = NULL;
+   }
+}
+
+// baseline: decode (or, for skipped chroma, just entropy-decode) one block of
+// component n into block position (bx,by) of its plane
+static int stbi__jpeg_baseline_block(stbi__jpeg *z, short data[64], int n, int bx, int by)
+{
+   int ha = z->img_comp[n].ha;
+   if (n && z->luma_only)
+      return stbi__jpeg_skip_block(z, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n);
+   if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+   stbi__jpeg_idct(z, n, z->img_comp[n].data+(z->img_comp[n].w2*by+bx)*z->img_comp[n].idct_size, data, 1);
+   return 1;
+}
+
+// number of MCUs in the current baseline scan; for a non-interleaved scan every
+// data block is an MCU, and the number of blocks just depends on how many actual
+// "pixels" the component has, independent of interleaved MCU blocking and such
+static int stbi__jpeg_scan_mcus(stbi__jpeg *z)
+{
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// decode MCU number 'mcu' of the current baseline scan (in scanline order)
+static int stbi__jpeg_baseline_mcu(stbi__jpeg *z, short data[64], int mcu)
+{
+   int k,x,y,i,j;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int w = (z->img_comp[n].x+7) >> 3;
+      return stbi__jpeg_baseline_block(z, data, n, mcu % w, mcu / w);
+   }
+   i = mcu % z->img_mcu_x;
+   j = mcu / z->img_mcu_x;
+   // scan an interleaved mcu... process scan_n components in order
+   for (k=0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      // scan out an mcu's worth of this component; that's just determined
+      // by the basic H and V specified for the component
+      for (y=0; y < z->img_comp[n].v; ++y)
+         for (x=0; x < z->img_comp[n].h; ++x)
+            if (!stbi__jpeg_baseline_block(z, data, n, i*z->img_comp[n].h + x, j*z->img_comp[n].v + y)) return 0;
+   }
+   return 1;
+}
+
+static stbi_jpeg_parallel_for *stbi__jpeg_parallel_for_fn = NULL;
+static void *stbi__jpeg_parallel_for_user = NULL;
+static int stbi__jpeg_parallel_threads = 1;
+
+STBIDEF void stbi_jpeg_set_parallel_for(stbi_jpeg_parallel_for *fn, void *user, int threads)
+{
+   stbi__jpeg_parallel_for_fn = fn;
+   stbi__jpeg_parallel_for_user = user;
+   stbi__jpeg_parallel_threads = threads;
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc *copies;        // one private decoder state per task, copy_stride bytes apart
+   int copy_stride;        // sizeof(stbi__jpeg) rounded up to 16, so every copy's idct_pend_buf stays SIMD-aligned
+   stbi_uc **start, **end; // entropy-coded bytes of each restart interval
+   stbi_uc *ok;            // per-task result
+   int mcus, intervals, tasks;
+} stbi__jpeg_restart_job;
+
+// decode a run of restart intervals on the task's private copy of the decoder
+// state; the intervals write disjoint blocks of the shared component planes
+static void stbi__jpeg_restart_task(void *arg, int t)
+{
+   stbi__jpeg_restart_job *job = (stbi__jpeg_restart_job *) arg;
+   stbi__jpeg *z = (stbi__jpeg *) (job->copies + (size_t) t * job->copy_stride);
+   stbi__context s = *job->z->s;
+   int q = job->intervals / job->tasks, rem = job->intervals % job->tasks;
+   int k    = t * q + (t < rem ? t : rem);
+   int kend = k + q + (t < rem);
+   int mcu, last;
+   STBI_SIMD_ALIGN(short, data[64]);
+   *z = *job->z;
+   z->s = &s;
+   job->ok[t] = 1;
+   for (; k < kend; ++k) {
+      s.img_buffer = job->start[k];
+      s.img_buffer_end = job->end[k]; // past the end stbi__get8 returns 0s, like after a marker
+      stbi__jpeg_reset(z);
+      mcu = k * z->restart_interval;
+      last = job->mcus;
+      if (last > mcu + z->restart_interval) last = mcu + z->restart_interval;
+      for (; mcu < last; ++mcu)
+         if (!stbi__jpeg_baseline_mcu(z, data, mcu)) break;
+      if (mcu != last) { job->ok[t] = 0; break; }
+   }
+   stbi__jpeg_idct_flush(z);
+}
+
+// baseline scan with restart markers, data in memory and a parallel_for hook set:
+// find the RST markers up front and decode the intervals concurrently. returns -1
+// if not applicable (caller decodes serially), else 0/1 for failure/success
+static int stbi__jpeg_parallel_restarts(stbi__jpeg *z)
+{
+   stbi__jpeg_restart_job job;
+   stbi_uc *p, *end, *scan_end;
+   int n, k, r;
+   if (!stbi__jpeg_parallel_for_fn || stbi__jpeg_parallel_threads < 2 || !z->restart_interval || z->s->read_from_callbacks)
+      return -1;
+   job.mcus = stbi__jpeg_scan_mcus(z);
+   n = (job.mcus + z->restart_interval - 1) / z->restart_interval;
+   if (n < 2) return -1;
+   job.z = z;
+   job.intervals = n;
+   job.tasks = stbi__jpeg_parallel_threads < n ? stbi__jpeg_parallel_threads : n;
+   // everything is allocated here, on the calling thread: the tasks themselves never allocate
+   job.start = (stbi_uc **) stbi__malloc_mad2(n, 2 * sizeof(stbi_uc *), 0);
+   job.ok = (stbi_uc *) stbi__malloc(job.tasks);
+   job.copy_stride = (int) ((sizeof(stbi__jpeg) + 15) & ~(size_t) 15);
+   job.copies = (stbi_uc *) stbi__malloc_mad2(job.tasks, job.copy_stride, 0);
+   if (!job.start || !job.ok || !job.copies) { STBI_FREE(job.start); STBI_FREE(job.ok); STBI_FREE(job.copies); return -1; }
+   job.end = job.start + n;
+
+   // pre-scan: RSTn separates intervals, any other marker ends the scan
+   k = 0;
+   job.start[0] = p = z->s->img_buffer;
+   scan_end = end = z->s->img_buffer_end;
+   for (; p + 1 < end; ++p) {
+      if (p[0] != 0xff || p[1] == 0x00 || p[1] == 0xff) continue; // data, stuffed 0xff, fill
+      if (!STBI__RESTART(p[1])) { scan_end = p; break; }
+      if (k + 1 >= n) { k = n; break; } // more markers than intervals
+      job.end[k++] = p;
+      job.start[k] = p + 2;
+      ++p;
+   }
+   if (k != n - 1) { // unexpected layout: leave it to the serial decoder
+      STBI_FREE(job.start); STBI_FREE(job.ok); STBI_FREE(job.copies);
+      return -1;
+   }
+   job.end[n-1] = scan_end;
+
+   stbi__jpeg_parallel_for_fn(stbi__jpeg_parallel_for_user, job.tasks, stbi__jpeg_restart_task, &job);
+
+   r = 1;
+   for (k=0; k < job.tasks; ++k)
+      if (!job.ok[k]) r = 0;
+   // continue after the scan as the serial decoder would: at the marker that ended it
+   z->s->img_buffer = job.end[n-1];
+   z->code_bits = 0;
+   z->code_buffer = 0;
+   z->nomore = 0;
+   z->marker = STBI__MARKER_none;
+   STBI_FREE(job.start); STBI_FREE(job.ok); STBI_FREE(job.copies);
+   return r ? 1 : stbi__err("bad huffman code","Corrupt JPEG");
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
    if (!z->progressive) {
-      if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
+      int mcu, mcus, r;
+      STBI_SIMD_ALIGN(short, data[64]);
+      r = stbi__jpeg_parallel_restarts(z);
+      if (r >= 0) return r;
+      mcus = stbi__jpeg_scan_mcus(z);
+      r = 1;
+      for (mcu=0; mcu < mcus; ++mcu) {
+         if (!stbi__jpeg_baseline_mcu(z, data, mcu)) { r = 0; break; }
+         // count down the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+            // if it's NOT a restart, then just bail, so we get corrupt data
+            // rather than no data
+            if (!STBI__RESTART(z->marker)) break;
+            stbi__jpeg_reset(z);
          }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
-         }
-         return 1;
       }
+      stbi__jpeg_idct_flush(z);
+      return r;
    } else {
       if (z->scan_n == 1) {
          int i,j;
@@ -3085,14 +3731,16 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
       for (n=0; n < z->s->img_n; ++n) {
          int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
+         if (n && z->luma_only) continue; // chroma coefficients were only needed for decoding
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               stbi__jpeg_idct(z, n, z->img_comp[n].data+(z->img_comp[n].w2*j+i)*z->img_comp[n].idct_size, data, 0);
             }
          }
       }
+      stbi__jpeg_idct_flush(z);
    }
 }
 
@@ -3297,6 +3945,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 
    if (!stbi__mad3sizes_valid(s->img_x, s->img_y, s->img_n, 0)) return stbi__err("too large", "Image too large to decode");
 
+   // grey output from YCbCr only needs Y: Cb/Cr still have to be entropy-decoded to
+   // get through the scan, but are never dequantized, IDCT'd, upsampled or converted
+   z->luma_only = z->want_grey && s->img_n == 3 && !(z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+
    for (i=0; i < s->img_n; ++i) {
       if (z->img_comp[i].h > h_max) h_max = z->img_comp[i].h;
       if (z->img_comp[i].v > v_max) v_max = z->img_comp[i].v;
@@ -3329,21 +3981,34 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      // scaled decode: subsampled components get a correspondingly larger IDCT (when the
+      // factor allows it) so they come out at output resolution and need no upsampling.
+      // h != v keeps the reduced IDCT and is upsampled later, which at 1/4 and 1/8
+      // leaves chroma at roughly DC detail (see stbi_jpeg_set_scale_denom)
+      {
+         int hs = h_max / z->img_comp[i].h, vs = v_max / z->img_comp[i].v;
+         z->img_comp[i].idct_size = z->idct_size;
+         if (hs == vs && (hs == 2 || hs == 4) && z->idct_size * hs <= 8)
+            z->img_comp[i].idct_size = z->idct_size * hs;
+      }
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * z->img_comp[i].idct_size;
+      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * z->img_comp[i].idct_size;
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
-      z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
-      if (z->img_comp[i].raw_data == NULL)
-         return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
-      // align blocks for idct using mmx/sse
-      z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
+      z->img_comp[i].raw_data = NULL;
+      if (!(i && z->luma_only)) { // skipped chroma has no pixel plane
+         z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+         if (z->img_comp[i].raw_data == NULL)
+            return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
+         // align blocks for idct using mmx/sse
+         z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
+      }
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // one coefficient block per 8x8 block, whatever the idct output size
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3820,7 +4485,10 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+   j->idct_size = 8;
    j->idct_block_kernel = stbi__idct_block;
+   j->idct_pair_kernel = NULL;
+   j->idct_pend = NULL;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3832,6 +4500,11 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__avx2_available())
+      j->idct_pair_kernel = stbi__idct_avx2_x2;
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -3873,10 +4546,24 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   // scaled decode: the component planes already hold idct_size pixels per block,
+   // so from here on the image is just a smaller one
+   if (z->idct_size < 8) {
+      int k, sc = 8 / z->idct_size;
+      z->s->img_x = (z->s->img_x + sc-1) / sc;
+      z->s->img_y = (z->s->img_y + sc-1) / sc;
+      for (k=0; k < z->s->img_n; ++k) {
+         int csc = 8 / z->img_comp[k].idct_size;
+         z->img_comp[k].x = (z->img_comp[k].x + csc-1) / csc;
+         z->img_comp[k].y = (z->img_comp[k].y + csc-1) / csc;
+      }
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
    is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+   if (z->luma_only) is_rgb = 0; // decided at SOF; a late APP14 can't bring the chroma back
 
    if (z->s->img_n == 3 && n < 3 && !is_rgb)
       decode_n = 1;
@@ -3904,8 +4591,9 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
          if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
+         // a scaled decode may already have brought a subsampled component to output size
+         r->hs      = z->img_h_max / z->img_comp[k].h * z->idct_size / z->img_comp[k].idct_size;
+         r->vs      = z->img_v_max / z->img_comp[k].v * z->idct_size / z->img_comp[k].idct_size;
          r->ystep   = r->vs >> 1;
          r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
          r->ypos    = 0;
@@ -4033,7 +4721,14 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    memset(j, 0, sizeof(stbi__jpeg));
    STBI_NOTUSED(ri);
    j->s = s;
+   j->want_grey = (req_comp == 1 || req_comp == 2);
    stbi__setup_jpeg(j);
+   switch (stbi__jpeg_scale_denom) {
+      case 2: j->idct_size = 4; break;
+      case 4: j->idct_size = 2; break;
+      case 8: j->idct_size = 1; break;
+      default: break;
+   }
    result = load_jpeg_image(j, x,y,comp,req_comp);
    STBI_FREE(j);
    return result;
@@ -4168,6 +4863,18 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
    return 1;
 }
 
+// fast inflate loop (see stbi__zinflate_fast) needs unaligned little-endian 8-byte loads
+#if !defined(STBI_NO_ZFAST64) && (defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__))
+#define STBI__ZFAST64
+#define STBI__ZLIT_BITS  11 // literal/length lookup width: up to two literals per lookup
+#define STBI__ZFAST_OUT  (258 + 8) // output room the fast loop keeps: one match plus copy overshoot
+#ifdef _MSC_VER
+typedef unsigned __int64 stbi__zbits;
+#else
+typedef unsigned long long stbi__zbits;
+#endif
+#endif
+
 // zlib-from-memory implementation for PNG reading
 //    because PNG allows splitting the zlib stream arbitrarily,
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
@@ -4187,6 +4894,12 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+#ifdef STBI__ZFAST64
+   // for the low STBI__ZLIT_BITS of the bit buffer: bits 24-27 first literal's code bits,
+   // 20-21 number of literals (0-2), 16-19 code bits used, 0-15 the literals (or 0-8 a
+   // length/end symbol); 0 if unresolved
+   stbi__uint32 lit_fast[1 << STBI__ZLIT_BITS];
+#endif
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4306,11 +5019,186 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+#ifdef STBI__ZFAST64
+// decode the code at the bottom of 'bits' (at least 16 valid bits) without consuming
+// it: the symbol and its length, or -1 exactly when stbi__zhuffman_decode_slowpath fails
+stbi_inline static int stbi__zhuffman_peek(const stbi__zhuffman *z, int bits, int *len)
+{
+   int b = z->fast[bits & STBI__ZFAST_MASK], s, k;
+   if (b) {
+      *len = b >> 9;
+      return b & 511;
+   }
+   k = stbi__bit_reverse(bits & 0xffff, 16);
+   for (s=STBI__ZFAST_BITS+1; ; ++s)
+      if (k < z->maxcode[s])
+         break;
+   if (s >= 16) return -1;
+   b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
+   if (b >= STBI__ZNSYMS) return -1;
+   if (z->size[b] != s) return -1;
+   *len = s;
+   return z->value[b];
+}
+
+static void stbi__zbuild_lit_fast(stbi__zbuf *a)
+{
+   int i;
+   for (i=0; i < (1 << STBI__ZLIT_BITS); ++i) {
+      // a code that fits in the index is fully determined by it
+      int s1, s2, c2, c1 = stbi__zhuffman_peek(&a->z_length, i, &s1);
+      stbi__uint32 e = 0;
+      if (c1 >= 0 && s1 <= STBI__ZLIT_BITS) {
+         e = ((stbi__uint32) s1 << 16) | (stbi__uint32) c1;
+         if (c1 < 256) {
+            e |= ((stbi__uint32) s1 << 24) | (1u << 20);
+            c2 = stbi__zhuffman_peek(&a->z_length, i >> s1, &s2);
+            if (c2 >= 0 && c2 < 256 && s1 + s2 <= STBI__ZLIT_BITS)
+               e = ((stbi__uint32) s1 << 24) | (2u << 20) | ((stbi__uint32) (s1+s2) << 16) | ((stbi__uint32) c2 << 8) | (stbi__uint32) c1;
+         }
+      }
+      a->lit_fast[i] = e;
+   }
+}
+
+// the plain decoder's bit count before it needs n bits: stbi__fill_bits tops it up
+// past 24 a byte at a time. near the end of the input, whether it ran out is
+// decided by how much it had buffered, so the fast loop keeps track of that too
+#define STBI__ZFILL(o, n)  if ((o) < (n)) (o) += (((24 - (o)) >> 3) + 1) << 3
+
+// bulk of a huffman block: while at least 16 input bytes and STBI__ZFAST_OUT bytes
+// of output room are left, decode from a 64-bit bit buffer refilled 8 bytes at a
+// time, with up to two literals per table lookup and 8-byte match copies. anything
+// unusual (end of block, a bad code or distance) stops it before that symbol is
+// consumed, and it hands back the exact bit buffer the plain decoder would have at
+// that point, so stbi__parse_huffman_block carries on with unchanged output and errors
+static char *stbi__zinflate_fast(stbi__zbuf *a, char *zout)
+{
+   stbi_uc *in = a->zbuffer, *p;
+   stbi__zbits bits = a->code_buffer;
+   int nbits = a->num_bits;
+   int o = a->num_bits; // num_bits of the plain decoder
+   int wide = a->z_expandable; // may write past the data: only in our own buffer
+   if (a->zbuffer_end - in < 16 || a->zout_end - zout < STBI__ZFAST_OUT)
+      return zout; // (the buffer may then hold zero bits past the end of the input)
+   do {
+      stbi__zbits next;
+      stbi__uint32 e;
+      int z, len, dist, used, s, oz;
+      char *src;
+
+      // refill to 56+ bits; the bits above nbits are the following input, so
+      // overlapping loads just rewrite the same values
+      memcpy(&next, in, 8);
+      bits |= next << nbits;
+      in += (63 - nbits) >> 3;
+      nbits |= 56;
+
+      e = a->lit_fast[bits & ((1 << STBI__ZLIT_BITS) - 1)];
+      if ((e >> 20) & 3) {
+         STBI__ZFILL(o, 16);
+         o -= (e >> 24) & 15;
+         zout[0] = (char) e;
+         if (((e >> 20) & 3) == 2) {
+            STBI__ZFILL(o, 16);
+            o -= ((e >> 16) & 15) - ((e >> 24) & 15);
+            zout[1] = (char) (e >> 8);
+         }
+         zout += (e >> 20) & 3;
+         used = (e >> 16) & 15;
+         bits >>= used;
+         nbits -= used;
+         continue;
+      }
+      if (e) {
+         z = e & 511;
+         used = (e >> 16) & 15;
+      } else {
+         z = stbi__zhuffman_peek(&a->z_length, (int) (bits & 0xffff), &used);
+         if (z < 0) break;
+         if (z < 256) {
+            STBI__ZFILL(o, 16);
+            o -= used;
+            *zout++ = (char) z;
+            bits >>= used;
+            nbits -= used;
+            continue;
+         }
+      }
+      if (z == 256 || z >= 286) break;
+
+      // a match takes at most 15+5+15+13 bits
+      oz = o;
+      STBI__ZFILL(oz, 16);
+      oz -= used;
+      z -= 257;
+      len = stbi__zlength_base[z];
+      s = stbi__zlength_extra[z];
+      STBI__ZFILL(oz, s);
+      oz -= s;
+      if (s) len += (int) (bits >> used) & ((1 << s) - 1);
+      used += s;
+      z = stbi__zhuffman_peek(&a->z_distance, (int) ((bits >> used) & 0xffff), &s);
+      if (z < 0 || z >= 30) break;
+      STBI__ZFILL(oz, 16);
+      oz -= s;
+      used += s;
+      dist = stbi__zdist_base[z];
+      s = stbi__zdist_extra[z];
+      STBI__ZFILL(oz, s);
+      oz -= s;
+      if (s) dist += (int) (bits >> used) & ((1 << s) - 1);
+      used += s;
+      if (zout - a->zout_start < dist) break;
+      o = oz;
+      bits >>= used;
+      nbits -= used;
+
+      src = zout - dist;
+      if (dist == 1) {
+         memset(zout, *src, len);
+         zout += len;
+      } else if (dist >= 8 && wide) {
+         char *end = zout + len;
+         do {
+            memcpy(zout, src, 8);
+            zout += 8;
+            src += 8;
+         } while (zout < end);
+         zout = end;
+      } else {
+         do *zout++ = *src++; while (--len);
+      }
+   } while (a->zbuffer_end - in >= 16 && a->zout_end - zout >= STBI__ZFAST_OUT);
+   // rebuild the plain decoder's buffer: the o bits from the current bit position
+   {
+      int sh = (-nbits) & 7; // position within its byte
+      stbi_uc *first = in - ((nbits + 7) >> 3);
+      stbi_uc *end = first + ((sh + o) >> 3);
+      bits = 0;
+      for (p = end; p > first; )
+         bits = (bits << 8) | *--p;
+      a->code_buffer = (stbi__uint32) (bits >> sh);
+      a->num_bits = o;
+      a->zbuffer = end;
+   }
+   return zout;
+}
+#undef STBI__ZFILL
+#endif
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
+#ifdef STBI__ZFAST64
+   stbi__zbuild_lit_fast(a);
+#endif
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+#ifdef STBI__ZFAST64
+      zout = stbi__zinflate_fast(a, zout);
+#endif
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4667,6 +5555,85 @@ static int stbi__paeth(int a, int b, int c)
    return t1;
 }
 
+#ifdef STBI_SSE2
+stbi_inline static __m128i stbi__load32_sse2(const stbi_uc *p)
+{
+   int v;
+   memcpy(&v, p, 4);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__store32_sse2(stbi_uc *p, __m128i v)
+{
+   int x = _mm_cvtsi128_si32(v);
+   memcpy(p, &x, 4);
+}
+
+// undo one scanline's filter with sse2 where it pays off: Up for any pixel size, Sub
+// for 1/3/4-byte pixels, Avg for 3/4-byte ones (Paeth stays with stbi__paeth, which a
+// pixel-at-a-time vector version doesn't beat). returns the number of bytes done
+// (whole pixels, never past nk), the caller does the rest in C.
+// 3/4-byte pixels go one per 32-bit lane; a 3-byte pixel's 4th byte is scratch that
+// the next pixel overwrites, so only pixels with 4 bytes left in the row are done
+static int stbi__png_unfilter_sse2(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int filter_bytes)
+{
+   int k = 0;
+   __m128i zero = _mm_setzero_si128();
+   __m128i a = zero; // previous pixel
+   switch (filter) {
+   case STBI__F_up:
+      for (; k + 16 <= nk; k += 16)
+         _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(_mm_loadu_si128((const __m128i *) (raw+k)), _mm_loadu_si128((const __m128i *) (prior+k))));
+      break;
+   case STBI__F_sub:
+      if (filter_bytes == 1 || filter_bytes == 4) {
+         // 16 bytes at a time: prefix sums with stride filter_bytes, plus the last pixel so far
+         for (; k + 16 <= nk; k += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (raw+k));
+            if (filter_bytes == 1) {
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+            }
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+            x = _mm_add_epi8(x, a);
+            _mm_storeu_si128((__m128i *) (cur+k), x);
+            // broadcast the last pixel
+            if (filter_bytes == 1) {
+               a = _mm_srli_si128(x, 15);
+               a = _mm_unpacklo_epi8(a, a);
+               a = _mm_unpacklo_epi16(a, a);
+            } else {
+               a = _mm_srli_si128(x, 12);
+            }
+            a = _mm_shuffle_epi32(a, 0);
+         }
+         if (filter_bytes == 1) break;
+      }
+      if (filter_bytes == 3 || filter_bytes == 4) {
+         for (; k + 4 <= nk; k += filter_bytes) {
+            a = _mm_add_epi8(a, stbi__load32_sse2(raw+k));
+            stbi__store32_sse2(cur+k, a);
+         }
+      }
+      break;
+   case STBI__F_avg:
+      if (filter_bytes == 3 || filter_bytes == 4) {
+         __m128i ones = _mm_set1_epi8(1);
+         for (; k + 4 <= nk; k += filter_bytes) {
+            __m128i b = stbi__load32_sse2(prior+k);
+            // (a+b)>>1: avg_epu8 rounds up, so take off the odd bit
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), ones));
+            a = _mm_add_epi8(stbi__load32_sse2(raw+k), avg);
+            stbi__store32_sse2(cur+k, a);
+         }
+      }
+      break;
+   }
+   return k;
+}
+#endif
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // adds an extra all-255 alpha channel
@@ -4707,6 +5674,12 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   // 8-bit without an added alpha channel: unfilter straight into the output rows
+   int direct = (depth == 8 && img_n == out_n);
+   int done;
+#ifdef STBI_SSE2
+   int simd = stbi__sse2_available();
+#endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4725,8 +5698,11 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
 
    // Allocate two scan lines worth of filter workspace buffer.
-   filter_buf = (stbi_uc *) stbi__malloc_mad2(img_width_bytes, 2, 0);
-   if (!filter_buf) return stbi__err("outofmem", "Out of memory");
+   filter_buf = NULL;
+   if (!direct) {
+      filter_buf = (stbi_uc *) stbi__malloc_mad2(img_width_bytes, 2, 0);
+      if (!filter_buf) return stbi__err("outofmem", "Out of memory");
+   }
 
    // Filtering for low-bit-depth images
    if (depth < 8) {
@@ -4735,13 +5711,22 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    }
 
    for (j=0; j < y; ++j) {
-      // cur/prior filter buffers alternate
-      stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
-      stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
+      stbi_uc *cur, *prior;
       stbi_uc *dest = a->out + stride*j;
       int nk = width * filter_bytes;
       int filter = *raw++;
 
+      if (direct) {
+         // unfilter in place against the previous output row; the first row's
+         // filters (first_row_filter) never read prior
+         cur = dest;
+         prior = j ? dest - stride : NULL;
+      } else {
+         // cur/prior filter buffers alternate
+         cur = filter_buf + (j & 1)*img_width_bytes;
+         prior = filter_buf + (~j & 1)*img_width_bytes;
+      }
+
       // check filter type
       if (filter > 4) {
          all_ok = stbi__err("invalid filter","Corrupt PNG");
@@ -4751,30 +5736,43 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
-      // perform actual filtering
+      // perform actual filtering; 'done' leading bytes (whole pixels) already are
+      done = 0;
+#ifdef STBI_SSE2
+      if (simd) done = stbi__png_unfilter_sse2(filter, cur, prior, raw, nk, filter_bytes);
+#endif
       switch (filter) {
       case STBI__F_none:
          memcpy(cur, raw, nk);
          break;
       case STBI__F_sub:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
+         if (!done) {
+            memcpy(cur, raw, filter_bytes);
+            done = filter_bytes;
+         }
+         for (k = done; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
          break;
       case STBI__F_up:
-         for (k = 0; k < nk; ++k)
+         for (k = done; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
          break;
       case STBI__F_avg:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
-         for (k = filter_bytes; k < nk; ++k)
+         if (!done) {
+            for (k = 0; k < filter_bytes; ++k)
+               cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
+            done = filter_bytes;
+         }
+         for (k = done; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
          break;
       case STBI__F_paeth:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-         for (k = filter_bytes; k < nk; ++k)
+         if (!done) {
+            for (k = 0; k < filter_bytes; ++k)
+               cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
+            done = filter_bytes;
+         }
+         for (k = done; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
          break;
       case STBI__F_avg_first:
@@ -4787,7 +5785,9 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       raw += nk;
 
       // expand decoded bits in cur to dest, also adding an extra alpha channel if desired
-      if (depth < 8) {
+      if (direct) {
+         // already in place
+      } else if (depth < 8) {
          stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
          stbi_uc *in = cur;
          stbi_uc *out = dest;